@@ -26,6 +26,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "common/regex.h"
 #include "common/tiniline.h"
 #include "common/systemd_escape.h"
+#include "common/hires_timer.h"
+#include "common/fmt_op.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -93,6 +95,33 @@ static bool create_config_file_if_necessary(const std::string& path)
 }
 //-------------------------------------------------------------------------------------------------
 
+std::string cache_dir(const user_info& usr_info)
+{
+  string dir = usr_info.user_home;
+  for(string_view rest = CACHE_DIR_PATH; rest.size();) //create each component
+   {
+    size_t p = rest.find('/', 1);
+    dir += rest.substr(0, p);
+    rest.remove_prefix(p == string_view::npos ? rest.size() : p);
+    if(!exists(dir) && mkdir(dir.c_str(), S_IRWXU))
+     { log("Could not create directory '" + dir + "': " + s_errno()); return {}; }
+   }
+  return dir;
+}
+//-------------------------------------------------------------------------------------------------
+
+static hires_timer program_start; //close enough to the start of main()
+
+void trace_startup(std::string_view stage)
+{
+  static hires_timer last = program_start;
+  if(!startup_trace) return;
+  cerr << "startup: {:8.1f} ms (+{:.1f}) {}\n" % $(program_start.microseconds() / 1000.0,
+                                                   last.microseconds() / 1000.0, stage);
+  last.reset();
+}
+//-------------------------------------------------------------------------------------------------
+
 mountopt_db_entry* program_settings::find(const std::string& fs_type,
                                           const std::string& label,
                                           const std::string& uuid)
@@ -162,15 +191,18 @@ void program_settings::load_settings(std::istream&& src)
         case GENERAL:
           ok = set_named_opt(ini.name, std::move(ini.value),
                              {"UseSudo", "DefaultOptions", "Mountpoint", "UseSystemctl",
-                              "UseSystemdMount", "UseSystemdUmount", "UseMtpfs"},
+                              "UseSystemdMount", "UseSystemdUmount", "UseMtpfs", "DeviceScan"},
                              use_sudo, default_opts, mountpoint, use_systemctl,
-                             use_systemd_mount,   use_systemd_umount, use_mtpfs);  break;
+                             use_systemd_mount,   use_systemd_umount, use_mtpfs,
+                             device_scan);                                         break;
         case NETSCAN:
           ok = set_named_opt(ini.name, std::move(ini.value),
-                             {"Hostname", "UseAvahi", "UseWSD",
-                              "UseNmap", "NmapNetworks"},
-                             use_hostname, use_avahi, use_wsd,
-                             use_nmap, nmap_networks);                             break;
+                             {"Hostname", "UseAvahi", "UseWSD", "UsePortProbe", "UseNmap",
+                              "NmapNetworks", "CommandTimeout", "MaxParallel", "ProbeWindow",
+                              "ProbeRate", "CacheDays"},
+                             use_hostname, use_avahi, use_wsd, use_probe, use_nmap,
+                             nmap_networks, netscan_timeout, netscan_parallel, probe_window,
+                             probe_rate, netscan_cache_days);                      break;
         case OPTIONS:
           auto& e = options_db.back();
           ok = set_named_opt(ini.name, std::move(ini.value),
@@ -181,6 +213,8 @@ void program_settings::load_settings(std::istream&& src)
    }
   if(!use_sudo.empty()) sudo_cmd = approved_sudo_cmd(use_sudo);
   default_mtpfs = select_mtpfs(use_mtpfs);
+  if(device_scan != "sysfs" && device_scan != "lsblk" && device_scan != "compare")
+   { log("Incorrect value for DeviceScan setting!"); device_scan = "sysfs"; }
   if(!regex_match(nmap_networks, "auto|(?:(?:(?:25[0-5]|(?:2[0-4]|1\\d|[1-9]|)\\d)\\.){2}"
                                  "(?:(?:25[0-5]|(?:2[0-4]|1\\d|[1-9]|)\\d)"
                                  "(?:-(?:25[0-5]|(?:2[0-4]|1\\d|[1-9]|)\\d))?\\.?){2}"
@@ -189,6 +223,16 @@ void program_settings::load_settings(std::istream&& src)
     section_comments["Netscan"] += "; NmapNetworks=" + nmap_networks + '\n';
     nmap_networks = "auto"; log("Incorrect value for NmapNetworks setting!");
    }
+  if(!regex_match(netscan_timeout, "[1-9]\\d{0,3}"_re))
+   { log("Incorrect value for CommandTimeout setting!"); netscan_timeout = "30"; }
+  if(!regex_match(netscan_parallel, "[1-9]\\d?"_re))
+   { log("Incorrect value for MaxParallel setting!"); netscan_parallel = "8"; }
+  if(!regex_match(probe_window, "[1-9]\\d{0,3}"_re))
+   { log("Incorrect value for ProbeWindow setting!"); probe_window = "256"; }
+  if(!regex_match(probe_rate, "\\d{1,5}"_re))
+   { log("Incorrect value for ProbeRate setting!"); probe_rate = "2000"; }
+  if(!regex_match(netscan_cache_days, "\\d{1,3}"_re))
+   { log("Incorrect value for CacheDays setting!"); netscan_cache_days = "7"; }
 }
 //-------------------------------------------------------------------------------------------------
 
@@ -230,17 +274,24 @@ bool program_settings::save_settings(const user_info& usr_info) const
        << "UseSystemctl"     << '=' << systemd_bool(use_systemctl)      << '\n'
        << "UseSystemdMount"  << '=' << systemd_bool(use_systemd_mount)  << '\n'
        << "UseSystemdUmount" << '=' << systemd_bool(use_systemd_umount) << '\n'
-       << "UseMtpfs"         << '=' << use_mtpfs                        << "\n\n";
+       << "UseMtpfs"         << '=' << use_mtpfs                        << '\n'
+       << "DeviceScan"       << '=' << device_scan                      << "\n\n";
 
   comment = section_comments.find("Netscan");
   if(comment != section_comments.end() && !comment->second.empty())
     file << comment->second;
 
   file << "[Netscan]\n" << "Hostname" << '=' << use_hostname << '\n'
-       << "UseAvahi"     << '=' << systemd_bool(use_avahi)   << '\n'
-       << "UseWSD"       << '=' << systemd_bool(use_wsd)     << '\n'
-       << "UseNmap"      << '=' << systemd_bool(use_nmap)    << '\n'
-       << "NmapNetworks" << '=' << nmap_networks             << "\n\n";
+       << "UseAvahi"       << '=' << systemd_bool(use_avahi) << '\n'
+       << "UseWSD"         << '=' << systemd_bool(use_wsd)   << '\n'
+       << "UsePortProbe"   << '=' << systemd_bool(use_probe) << '\n'
+       << "UseNmap"        << '=' << systemd_bool(use_nmap)  << '\n'
+       << "NmapNetworks"   << '=' << nmap_networks           << '\n'
+       << "CommandTimeout" << '=' << netscan_timeout         << '\n'
+       << "MaxParallel"    << '=' << netscan_parallel        << '\n'
+       << "ProbeWindow"    << '=' << probe_window            << '\n'
+       << "ProbeRate"      << '=' << probe_rate              << '\n'
+       << "CacheDays"      << '=' << netscan_cache_days      << "\n\n";
 
   comment = section_comments.find("Aliases");
   if(comment != section_comments.end() && !comment->second.empty())
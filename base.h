@@ -63,6 +63,7 @@ class program_settings
 {
 public:
   program_settings() = default;
+  program_settings(const program_settings&) = default;
   program_settings& operator= (program_settings&&) = default;
 
   typedef std::vector<mountopt_db_entry> opt_db_t;
@@ -74,7 +75,13 @@ public:
   std::string default_opts = "nodev,nosuid";
   std::string default_mtpfs;
   std::string use_mtpfs     = "auto";
+  std::string device_scan   = "sysfs";
   std::string nmap_networks = "auto";
+  std::string netscan_timeout = "30"; ///<seconds per command (smbclient, showmount, ...)
+  std::string netscan_parallel = "8"; ///<hosts probed at once
+  std::string probe_window = "256";  ///<port probe connections in flight
+  std::string probe_rate   = "2000"; ///<port probe connections per second, 0 - unlimited
+  std::string netscan_cache_days = "7"; ///<keep shares not seen again in cache, 0 - no cache
   std::string use_hostname  = "auto";
   std::string hostname;
   bool use_systemctl      = false;
@@ -82,7 +89,8 @@ public:
   bool use_systemd_umount = true;
   bool use_avahi = true;
   bool use_wsd   = true;
-  bool use_nmap  = true;
+  bool use_probe = true; ///<built-in TCP port probe
+  bool use_nmap  = false;
   std::map<std::string, std::string> aliases;
   std::map<std::string, std::string> section_comments; //comments *before* sections
   opt_db_t options_db;
@@ -107,6 +115,16 @@ std::string toupper(std::string_view src);
 
 ///Check file existence with stat(2)
 bool exists(const std::string& path) noexcept;
+
+/** @brief Directory for cached data (~/.cache/mount-gui), created if necessary.
+ *  @details Returns empty string on error. Privileges should be dropped by caller.
+ */
+std::string cache_dir(const user_info& usr_info);
+
+///Set by --startup-trace
+inline bool startup_trace = false;
+///Print time since program start and since previous stage to stderr (if startup_trace is set).
+void trace_startup(std::string_view stage);
 //-------------------------------------------------------------------------------------------------
 
 inline std::string filename(const std::string& path)
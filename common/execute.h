@@ -28,6 +28,8 @@ SOFTWARE.
 #define KIRILLNOW_EXECUTE_H
 //-------------------------------------------------------------------------------------------------
 #include "tpopen.h"
+#include <chrono>
+#include <stop_token>
 
 //forward declarations; project code should contain those
 void log(std::string s, const char* color);
@@ -35,45 +37,127 @@ void refresh_ui();
 const std::string& exename(const std::vector<std::string>& params);
 //-------------------------------------------------------------------------------------------------
 
-inline int execute(const std::vector<std::string> &params, std::stringstream &s_out,
-                   bool log_err = true, bool log_out = false, const std::string& s_in = "")
+///Cancellation and deadline for execute() calls made by the current thread.
+struct execute_limits
+{
+  std::stop_token stop; ///<e.g. of worker std::jthread
+  int timeout_ms = 0;   ///<per command, 0 - no deadline
+  int grace_ms = 2000;  ///<between SIGTERM and SIGKILL
+};
+inline thread_local execute_limits exec_limits;
+
+///Sets exec_limits.timeout_ms while in scope.
+struct execute_timeout
+{
+  int prev;
+  explicit execute_timeout(int ms) :prev{exec_limits.timeout_ms} { exec_limits.timeout_ms = ms; }
+  ~execute_timeout() { exec_limits.timeout_ms = prev; }
+};
+//-------------------------------------------------------------------------------------------------
+
+/** @brief Log complete lines from process output read so far.
+ *  @details Stderr lines are consumed; stdout is kept for the caller, `logged` is the
+ *  length of its already logged part. At eof incomplete last lines are logged too.
+ */
+inline void execute_log(Tp_open& proc, bool log_err, bool log_out, size_t& logged,
+                        bool at_eof = false)
+{
+  if(log_out)
+   {
+    std::string_view v = proc.s_out.view().substr(logged);
+    for(size_t p; (p = v.find('\n')) != v.npos; v.remove_prefix(p + 1), logged += p + 1)
+      log(std::string(v.substr(0, p)), "");
+    if(at_eof && v.size()) { log(std::string(v), ""); logged += v.size(); }
+   }
+  if(log_err)
+    for(std::string_view line : proc.s_err.lines(at_eof))
+      log(std::string(line), "orange");
+}
+//-------------------------------------------------------------------------------------------------
+
+///Wait for process exit, move its output to s_out; `status` is -1 if transfer failed.
+inline int execute_finish(Tp_open& proc, const std::vector<std::string> &params,
+                          Tp_buffer &s_out, bool log_err, int status)
+{
+  if(proc.opened()) status |= proc.close(); //not ||
+  s_out = std::move(proc.s_out);
+
+  if(log_err && status)
+    log("Error: " + exename(params) + " exited with status " + std::to_string(status), "red");
+  return status;
+}
+//-------------------------------------------------------------------------------------------------
+
+/** @brief Common loop of execute() variants.
+ *  @details on_data(proc, at_eof) is called after each transfer and once more at eof.
+ */
+template<class F>
+inline int execute_loop(const std::vector<std::string> &params, Tp_buffer &s_out,
+                        bool log_err, const std::string& s_in, F&& on_data)
 {
   Tp_open proc(params);
   if(!proc) { log(proc.err(), "red");
               log("Error: execution of " + exename(params) + " failed.", "red"); return -1; }
 
-  size_t s_in_sz = s_in.size();
-  if(s_in_sz) proc.s_in.str(s_in);
+  proc.s_in.append(s_in);
+  bool close_in = s_in.size();
 
+  using clock = std::chrono::steady_clock;
+  const auto deadline = clock::now() + std::chrono::milliseconds(exec_limits.timeout_ms);
   int status = 0;
   for(; !proc.eof(); refresh_ui())
    {
+    const bool cancel = exec_limits.stop.stop_requested();
+    if(cancel || (exec_limits.timeout_ms && clock::now() > deadline))
+     {
+      log((cancel ? "Cancelled, stopping " : "Timed out, stopping ") + exename(params), "orange");
+      proc.terminate(exec_limits.grace_ms);
+      status = -1; break;
+     }
     if(proc.sync() < 0) { status = -1; break; }
-    if(log_out && proc.s_out.peek() != std::char_traits<char>::eof())
-      for(std::string line; getline(proc.s_out, line); )
-        { log(line, ""); }
-    if(log_err && proc.s_err.peek() != std::char_traits<char>::eof())
-      for(std::string line; getline(proc.s_err, line); )
-        { log(line, "orange"); }
-    if(s_in_sz)
-      if(auto p = proc.s_in.tellg(); p == decltype(p)(-1) || p >= s_in_sz)
-        if(!proc.close_0()) s_in_sz = 0;
+    on_data(proc, false);
+    if(close_in && proc.s_in.empty())
+      { proc.close_0(); close_in = false; }
    }
-  status |= proc.close(); //not ||
+  on_data(proc, true);
+  return execute_finish(proc, params, s_out, log_err, status);
+}
+//-------------------------------------------------------------------------------------------------
 
-  s_out = std::move(proc.s_out);
-  s_out.seekg(0, std::ios_base::beg);
-  s_out.clear(); //flags, not content
+/** @brief Run process, wait for it to finish.
+ *  @details s_out receives whole stdout, use s_out.lines() to parse it in place.
+ *  Returns exit status, or -1 if the process failed, timed out or was cancelled.
+ */
+inline int execute(const std::vector<std::string> &params, Tp_buffer &s_out,
+                   bool log_err = true, bool log_out = false, const std::string& s_in = "")
+{
+  size_t logged = 0;
+  return execute_loop(params, s_out, log_err, s_in, [&](Tp_open& proc, bool at_eof)
+                      { execute_log(proc, log_err, log_out, logged, at_eof); });
+}
+//-------------------------------------------------------------------------------------------------
 
-  if(log_err && status)
-    log("Error: " + exename(params) + " exited with status " + std::to_string(status), "red");
-  return status;
+/** @brief Run process, calling on_line(std::string_view) for each stdout line as it arrives.
+ *  @details Lines read before the process failed or was stopped are still delivered.
+ *  Returns exit status like execute().
+ */
+template<class F>
+inline int execute_lines(const std::vector<std::string> &params, F&& on_line,
+                         bool log_err = true, const std::string& s_in = "")
+{
+  Tp_buffer rest;
+  return execute_loop(params, rest, log_err, s_in, [&](Tp_open& proc, bool at_eof)
+   {
+    size_t logged = 0;
+    execute_log(proc, log_err, false, logged, at_eof);
+    for(std::string_view line : proc.s_out.lines(at_eof)) on_line(line);
+   });
 }
 //-------------------------------------------------------------------------------------------------
 
 inline int execute(const std::vector<std::string> &params, bool log_err = true,
                    bool log_out = false, const std::string& s_in = "")
-{ std::stringstream tmp; return execute(params, tmp, log_err, log_out, s_in); }
+{ Tp_buffer tmp; return execute(params, tmp, log_err, log_out, s_in); }
 
 //-------------------------------------------------------------------------------------------------
 #endif // KIRILLNOW_EXECUTE_H
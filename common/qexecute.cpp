@@ -0,0 +1,153 @@
+/* Copyright (c) 2015-2023 Kovshov K.A.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/** @file qexecute.cpp
+ *  @author Kovshov K.A. (kirillnow@gmail.com)
+ *  @brief Event-driven execute() for Qt applications.
+ */
+//-------------------------------------------------------------------------------------------------
+
+#include "qexecute.h"
+#include <QCoreApplication>
+#include <QSocketNotifier>
+#include <QTimer>
+#include <optional>
+#include <utility>
+#include <signal.h>
+
+using namespace std;
+//-------------------------------------------------------------------------------------------------
+namespace {
+///Running process; deletes itself after `done` is called.
+class Tq_execute : public QObject
+{
+  Tp_open proc;
+  vector<string> params;
+  execute_done_fn done;
+  bool   log_err, log_out;
+  size_t logged = 0; //see execute_log()
+  int    status = 0;
+  bool   exiting = false, stopping = false, finished = false;
+  const execute_limits limits = exec_limits; //of the thread that started the process
+  optional<stop_callback<function<void()>>> on_stop;
+  QSocketNotifier *n_in = nullptr, *n_out = nullptr, *n_err = nullptr;
+
+  QSocketNotifier* notifier(Tp_open::stream s)
+  {
+    auto* n = new QSocketNotifier(proc.fd(s), s == Tp_open::IN ? QSocketNotifier::Write
+                                                                : QSocketNotifier::Read, this);
+    connect(n, &QSocketNotifier::activated, this,
+            [this, s] { s == Tp_open::IN ? on_write() : on_read(s); });
+    return n;
+  }
+
+  void on_read(Tp_open::stream s)
+  {
+    int r = proc.sync(s);
+    execute_log(proc, log_err, log_out, logged);
+    if(r < 0) return reap(-1);
+    if(proc.eof(s)) (s == Tp_open::OUT ? n_out : n_err)->setEnabled(false);
+    if(proc.eof()) reap(0);
+  }
+
+  void on_write()
+  {
+    if(proc.sync(Tp_open::IN) < 0) return reap(-1);
+    if(!proc.eof(Tp_open::IN) && !proc.s_in.empty()) return;
+    n_in->setEnabled(false); n_in->deleteLater(); n_in = nullptr;
+    proc.close_0();
+  }
+
+  ///Timeout or stop request: SIGTERM, then SIGKILL after grace_ms, without waiting here.
+  void stop(bool cancel)
+  {
+    if(stopping || finished) return;
+    stopping = true;
+    log((cancel ? "Cancelled, stopping " : "Timed out, stopping ") + exename(params), "orange");
+    if(!proc.wait_exit(0) && proc.signal(SIGTERM))
+      QTimer::singleShot(limits.grace_ms, this, [this] { if(!finished) proc.signal(SIGKILL); });
+    reap(-1);
+  }
+
+  ///Call finish() once the process has exited, so close() does not block in waitpid().
+  void reap(int st)
+  {
+    for(auto* n : {n_in, n_out, n_err}) if(n) n->setEnabled(false);
+    status |= st;
+    if(exchange(exiting, true)) return;
+    if(proc.wait_exit(0)) return finish();
+    if(proc.pidfd() >= 0) //readable once the process exits
+     {
+      auto* n = new QSocketNotifier(proc.pidfd(), QSocketNotifier::Read, this);
+      connect(n, &QSocketNotifier::activated, this, [this, n] { n->setEnabled(false); finish(); });
+      return;
+     }
+    auto* t = new QTimer(this); //old kernel: poll for exit
+    connect(t, &QTimer::timeout, this, [this, t]
+            { if(proc.wait_exit(0)) { t->stop(); finish(); } });
+    t->start(50);
+  }
+
+  void finish()
+  {
+    if(exchange(finished, true)) return;
+    on_stop.reset();
+    Tp_buffer s_out;
+    execute_log(proc, log_err, log_out, logged, true);
+    status = execute_finish(proc, params, s_out, log_err, status);
+    deleteLater();
+    try { if(done) done(status, s_out); }
+    catch(...) { log("Error: exception after " + exename(params) + " has finished.", "red"); }
+  }
+
+public:
+  Tq_execute(const vector<string> &p, execute_done_fn d, bool le, bool lo)
+    :QObject{qApp}, params{p}, done{std::move(d)}, log_err{le}, log_out{lo} {}
+
+  bool start(const string& s_in)
+  {
+    if(!proc.open(params))
+     { log(proc.err(), "red");
+       log("Error: execution of " + exename(params) + " failed.", "red"); return false; }
+    if(s_in.size())
+     { proc.s_in.append(s_in); n_in = notifier(Tp_open::IN); }
+    n_out = notifier(Tp_open::OUT);
+    n_err = notifier(Tp_open::ERR);
+    if(limits.timeout_ms)
+      QTimer::singleShot(limits.timeout_ms, this, [this] { stop(false); });
+    if(limits.stop.stop_possible()) //request_stop() may come from any thread
+      on_stop.emplace(limits.stop, [this]
+        { QMetaObject::invokeMethod(this, [this] { stop(true); }, Qt::QueuedConnection); });
+    return true;
+  }
+};
+}
+//-------------------------------------------------------------------------------------------------
+
+bool execute_async(const std::vector<std::string> &params, execute_done_fn done,
+                   bool log_err, bool log_out, const std::string& s_in)
+{
+  auto* p = new Tq_execute(params, std::move(done), log_err, log_out);
+  if(p->start(s_in)) return true;
+  delete p;
+  return false;
+}
+//-------------------------------------------------------------------------------------------------
@@ -0,0 +1,48 @@
+/* Copyright (c) 2015-2023 Kovshov K.A.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/** @file qexecute.h
+ *  @author Kovshov K.A. (kirillnow@gmail.com)
+ *  @brief Event-driven execute() for Qt applications.
+ */
+
+#ifndef KIRILLNOW_QEXECUTE_H
+#define KIRILLNOW_QEXECUTE_H
+//-------------------------------------------------------------------------------------------------
+#include "execute.h"
+#include <functional>
+
+using execute_done_fn = std::function<void(int status, Tp_buffer &s_out)>;
+//-------------------------------------------------------------------------------------------------
+
+/** @brief Start process and return immediately, its pipes are served by Qt event loop.
+ *  @details Logs the same way as execute(). `done` is called from event loop with exit status
+ *  and everything process wrote to stdout. Returns false (`done` is never called then)
+ *  if the process could not be started. Must be called from a thread running Qt event loop.
+ *  exec_limits of the calling thread apply as in execute(): on timeout or stop request the
+ *  process gets SIGTERM, then SIGKILL after grace_ms, and status is -1. The event loop is
+ *  never blocked: the process is reaped once its pidfd reports exit.
+ */
+bool execute_async(const std::vector<std::string> &params, execute_done_fn done,
+                   bool log_err = true, bool log_out = false, const std::string& s_in = "");
+
+//-------------------------------------------------------------------------------------------------
+#endif // KIRILLNOW_QEXECUTE_H
@@ -28,6 +28,7 @@ SOFTWARE.
 #define KIRILLNOW_REGEX_H_INCLUDED
 //-------------------------------------------------------------------------------------------------
 #include <regex>
+#include <string_view>
 #include <array>
 #include <unordered_map>
 
@@ -71,6 +72,11 @@ inline const std::basic_regex<typename decltype(S)::T>& operator "" _ire()
 }
 #endif
 //-------------------------------------------------------------------------------------------------
+///std::regex_match() for std::string_view, e.g. lines of Tp_buffer
+inline bool regex_match(std::string_view s, std::cmatch& m, const std::regex& e,
+                        std::regex_constants::match_flag_type f = std::regex_constants::match_default)
+{ return std::regex_match(s.data(), s.data() + s.size(), m, e, f); }
+//-------------------------------------------------------------------------------------------------
 ///Wrapper for using std::regex_iterator in range-for loops
 struct re_iter
 {
@@ -30,64 +30,56 @@ SOFTWARE.
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/wait.h>
+#include <spawn.h>
+#include <signal.h>
+#include <sys/syscall.h>
 #include <poll.h>
 
 using namespace std;
 //-------------------------------------------------------------------------------------------------
 bool Tp_open::open(const std::string &executable, const std::vector<std::string> &args)
 {
-  using ::close; using ::read; using ::write;
+  using ::close;
   if(opened()) return false;
 
   vector<const char*> c_args;
   for(const auto& i: args) c_args.emplace_back(i.c_str());
   c_args.push_back(nullptr);
 
-  int p_in[2], p_out[2], p_err[2], p_sync[2];
-  if(pipe2(p_in, O_CLOEXEC) || pipe2(p_out, O_CLOEXEC) ||
-     pipe2(p_err, O_CLOEXEC) || pipe2(p_sync, O_CLOEXEC) )
-   { s_err << "Failed to perform pipe2(2): " << strerror(errno) << ".\n"; return false; }
+  int p_in[2], p_out[2], p_err[2];
+  if(pipe2(p_in, O_CLOEXEC) || pipe2(p_out, O_CLOEXEC) || pipe2(p_err, O_CLOEXEC))
+   { s_err.append("Failed to perform pipe2(2): "s + strerror(errno) + ".\n"); return false; }
   if(fcntl(p_in[1], F_SETFL, O_NONBLOCK) || fcntl(p_out[0], F_SETFL, O_NONBLOCK)
                                          || fcntl(p_err[0], F_SETFL, O_NONBLOCK) )
-   { s_err << "Failed to perform fcntl(2): " << strerror(errno) << ".\n"; return false; }
-
-  proc_pid=fork();
-  if(proc_pid == -1)
-   { s_err << "Failed to perform fork(2): " << strerror(errno) << ".\n"; return false; }
-  if(proc_pid==0)
-   {
-    if( dup2(p_in[0], 0)<0 || dup2(p_out[1], 1)<0 || dup2(p_err[1], 2)<0 )
-     {
-      const char* msg="Failed to perform dup2(2).\n";
-      write(p_sync[1], "1", 1); write(p_err[1], msg, strlen(msg)); _exit(1);
-     }
-    if( close(p_in[0]) || close(p_out[0]) || close(p_err[0]) ||
-        close(p_in[1]) || close(p_out[1]) || close(p_err[1])   )
-     {
-      const char* msg="Failed to perform close(2).\n";
-      write(p_sync[1], "1", 1); write(2, msg, strlen(msg)); _exit(1);
-     }
-
-    execvp(executable.c_str(), (char* const*)c_args.data());
-    const char* msg="Failed to perform execvp(3): ";
-    const char* msg2=strerror(errno);
-    write(p_sync[1], "1", 1); write(2, msg, strlen(msg));
-    write(2, msg2, strlen(msg2)); write(2, "\n", 1);
-    _exit(1);
-   }
-
-  if( close(p_in[0]) || close(p_out[1]) || close(p_err[1]) || close(p_sync[1]) )
-   { s_err << "!Failed to perform close(2)!: " << strerror(errno) << ".\n"; return false; }
+   { s_err.append("Failed to perform fcntl(2): "s + strerror(errno) + ".\n"); return false; }
+
+  //posix_spawn() uses vfork semantics, so it does not copy page tables of a large parent;
+  //exec failure is returned as error code, no sync pipe is needed.
+  //Pipe ends are O_CLOEXEC, only the duplicated 0,1,2 survive exec.
+  posix_spawn_file_actions_t fa;
+  int rt = posix_spawn_file_actions_init(&fa);
+  if(!rt && !(rt = posix_spawn_file_actions_adddup2(&fa, p_in[0],  0)) &&
+            !(rt = posix_spawn_file_actions_adddup2(&fa, p_out[1], 1)) &&
+            !(rt = posix_spawn_file_actions_adddup2(&fa, p_err[1], 2)))
+    rt = posix_spawnp(&proc_pid, executable.c_str(), &fa, nullptr,
+                      (char* const*)c_args.data(), environ);
+  posix_spawn_file_actions_destroy(&fa);
+
+  if( close(p_in[0]) || close(p_out[1]) || close(p_err[1]) )
+   { s_err.append("!Failed to perform close(2)!: "s + strerror(errno) + ".\n"); return false; }
   pipe_in=p_in[1]; pipe_out=p_out[0]; pipe_err=p_err[0];
 
-  if( read(p_sync[0], &p_sync[1], 1) > 0 )
+  if(rt)
    {
-    this->sync(); waitpid(proc_pid, nullptr, 0);
-    close(pipe_in); close(pipe_out); close(pipe_err); close(p_sync[0]);
-    f_eof=true; /* ??? */ return false;
+    s_err.append("Failed to perform posix_spawnp(3): "s + strerror(rt) + ".\n");
+    close(pipe_in); close(pipe_out); close(pipe_err);
+    pipe_in = pipe_out = pipe_err = -1; proc_pid = -1;
+    f_eof=true; return false;
    }
-  close(p_sync[0]);
-  f_opened=true; f_eof=false;
+#ifdef SYS_pidfd_open
+  pid_fd = syscall(SYS_pidfd_open, proc_pid, 0);  //O_CLOEXEC implied
+#endif
+  f_opened=true; f_eof=false; eof_bits=0;
   return true;
 }
 //-------------------------------------------------------------------------------------------------
@@ -98,81 +90,161 @@ int Tp_open::close()
 
   if((pipe_in >= 0 && close(pipe_in)) || (pipe_out >= 0 && close(pipe_out)) ||
                                          (pipe_err >= 0 && close(pipe_err)))
-   { s_err << "Failed to perform close(2): " << strerror(errno) << ".\n"; return -1; }
+   { s_err.append("Failed to perform close(2): "s + strerror(errno) + ".\n"); return -1; }
+  pipe_in = pipe_out = pipe_err = -1;
   int status=0, rt=0;
-  while((rt=waitpid(proc_pid, &status, 0)) == 0);
+  while((rt=waitpid(proc_pid, &status, 0)) < 0 && errno == EINTR) ;
+  if(pid_fd >= 0) { close(pid_fd); pid_fd = -1; }
+  f_opened=false;
   if( rt < 0)
-   { s_err << "Failed to perform waitpid(2): " << strerror(errno) << ".\n"; return -1; }
+   { s_err.append("Failed to perform waitpid(2): "s + strerror(errno) + ".\n"); return -1; }
   status = WIFEXITED(status) ? WEXITSTATUS(status) : WTERMSIG(status)+128;
-  f_opened=false;
   return status;
 }
 //-------------------------------------------------------------------------------------------------
 
+bool Tp_open::signal(int sig)
+{
+  if(!f_opened) return false;
+#ifdef SYS_pidfd_send_signal
+  if(pid_fd >= 0) return !syscall(SYS_pidfd_send_signal, pid_fd, sig, nullptr, 0);
+#endif
+  return !kill(proc_pid, sig);
+}
+//-------------------------------------------------------------------------------------------------
+
+bool Tp_open::wait_exit(int timeout_ms)
+{
+  if(!f_opened) return true;
+  if(pid_fd >= 0)
+   {
+    pollfd fd = {pid_fd, POLLIN, 0};
+    int rt;
+    while((rt = poll(&fd, 1, timeout_ms)) < 0 && errno == EINTR) ;
+    return rt != 0;
+   }
+  //old kernel: poll waitid() without reaping
+  for(int t = 0;; t += 10)
+   {
+    siginfo_t si{};
+    if(waitid(P_PID, proc_pid, &si, WEXITED|WNOHANG|WNOWAIT) || si.si_pid) return true;
+    if(t >= timeout_ms) return false;
+    usleep(10000);
+   }
+}
+//-------------------------------------------------------------------------------------------------
+
+int Tp_open::terminate(int grace_ms)
+{
+  if(!f_opened) return -1;
+  if(!wait_exit(0) && signal(SIGTERM) && !wait_exit(grace_ms))
+    signal(SIGKILL);
+  return close();
+}
+//-------------------------------------------------------------------------------------------------
+
 bool Tp_open::close_0()
 {
   if(pipe_in < 0 || !::close(pipe_in)) { pipe_in = -1; return true; }
-  s_err << "Failed to perform close(2): " << strerror(errno) << ".\n";
+  s_err.append("Failed to perform close(2): "s + strerror(errno) + ".\n");
   return false;
 }
 //-------------------------------------------------------------------------------------------------
 
+///Read everything available from non-blocking pipe; -1 on error.
+static int read_pipe(int fd, Tp_buffer& b, size_t chunk, bool& eof)
+{
+  int rt = 0, sum = 0;
+  while(1)
+   {
+    char* p = b.prepare(b.room() >= chunk / 16 ? b.room() : chunk);
+    while((rt = ::read(fd, p, b.room())) == -1 && errno==EINTR) ;
+
+    if(rt > 0) { b.commit(rt); sum+=rt; continue; }
+    if(rt==0) { eof = true; return sum; }
+
+    if(errno == EAGAIN || errno == EWOULDBLOCK)  return sum;
+    return -1;
+   }
+}
+//-------------------------------------------------------------------------------------------------
+
+///Write as much of b as non-blocking pipe accepts; -1 on error.
+static int write_pipe(int fd, Tp_buffer& b, bool& eof)
+{
+  int rt = 0, sum = 0;
+  while(!b.empty())
+   {
+    while((rt = ::write(fd, b.view().data(), b.size())) == -1 && errno==EINTR) ;
+
+    if(rt >= 0) { b.consume(rt); sum+=rt; continue; }
+
+    if(errno == EPIPE) { eof = true; break; }
+    if(errno == EAGAIN || errno == EWOULDBLOCK)  break;
+    return -1;
+   }
+  return sum;
+}
+//-------------------------------------------------------------------------------------------------
+
 int Tp_open::sync()
 {
   if(!f_opened) return -1;
 
-  int rt = 0, sum = 0, count = 0, eof_cnt = 0;
-  char buffer[BUFF_SZ];
+  int rt = 0, sum = 0, eof_cnt = 0;
   pollfd fd_pool[] = {{pipe_out, POLLIN, 0}, {pipe_err, POLLIN, 0}, {pipe_in, POLLOUT, 0}};
 
-  s_in.clear();
-  const bool do_write = (pipe_in >= 0 && s_in.peek() != char_traits<char>::eof());
+  const bool do_write = (pipe_in >= 0 && !s_in.empty());
 
   if( (rt=poll(fd_pool, do_write?3:2, timeout)) <= 0)
    {
-    if(rt==0 || rt==EINTR) return 0;
-    s_err << "Failed to perform poll(2): " << strerror(errno) << ".\n"; return -1;
+    if(rt==0 || errno==EINTR) return 0;
+    s_err.append("Failed to perform poll(2): "s + strerror(errno) + ".\n"); return -1;
    }
 
   if( fd_pool[0].revents & (POLLERR|POLLNVAL) ||
       fd_pool[1].revents & (POLLERR|POLLNVAL) || fd_pool[2].revents & POLLNVAL )
-   { s_err << "Pipe polling failed.\n"; return -1; }
+   { s_err.append("Pipe polling failed.\n"); return -1; }
 
-  s_err.clear(); s_out.clear();
   for(int i=0; i<2; ++i)
    {
     if(!fd_pool[i].revents) continue;
-    while(1)
-     {
-      while((rt = ::read(fd_pool[i].fd, buffer, BUFF_SZ)) == -1 && errno==EINTR) ;
-
-      if(rt > 0) { (i?s_err:s_out).write(buffer, rt); sum+=rt; continue; }
-      if(rt==0) { ++eof_cnt; break; }
-
-      if(errno == EAGAIN || errno == EWOULDBLOCK)  break;
-      s_err << "Failed to perform read(2): " << strerror(errno) << ".\n"; return -1;
-     }
+    bool eof = false;
+    if((rt = read_pipe(fd_pool[i].fd, i?s_err:s_out, BUFF_SZ, eof)) < 0)
+     { s_err.append("Failed to perform read(2): "s + strerror(errno) + ".\n"); return -1; }
+    sum+=rt; eof_cnt+=eof;
    }
   if(fd_pool[2].revents & POLLERR)
    { ++eof_cnt; }
   else if(fd_pool[2].revents)
    {
-    while( s_in.read(buffer, BUFF_SZ), (count=s_in.gcount()) > 0 )
-     {
-      while((rt = ::write(pipe_in, buffer, count)) == -1 && errno==EINTR) ;
-
-      if(rt < count)  s_in.seekg(-(count-std::max(rt, 0)), ios_base::cur);
-      if(rt >= 0) { sum+=rt; continue; }
-
-      if(errno == EPIPE) { ++eof_cnt; break; }
-      if(errno == EAGAIN || errno == EWOULDBLOCK)  break;
-      s_err << "Failed to perform write(2): " << strerror(errno) << ".\n"; return -1;
-     }
+    bool eof = false;
+    if((rt = write_pipe(pipe_in, s_in, eof)) < 0)
+     { s_err.append("Failed to perform write(2): "s + strerror(errno) + ".\n"); return -1; }
+    sum+=rt; eof_cnt+=eof;
    }
 
   if(eof_cnt == (do_write+2)) f_eof = true;  //all 3 pipes should be closed to set eof flag.
-
-  s_err.clear(); s_out.clear(); s_in.clear();
   return sum;
 }
 //-------------------------------------------------------------------------------------------------
+
+int Tp_open::sync(stream s)
+{
+  if(!f_opened) return -1;
+  if(fd(s) < 0 || eof(s)) return 0;
+
+  bool eof = false;
+  int rt = (s == IN) ? write_pipe(pipe_in, s_in, eof)
+                     : read_pipe(fd(s), (s == OUT) ? s_out : s_err, BUFF_SZ, eof);
+  if(rt < 0)
+   {
+    s_err.append("Failed to perform "s + (s == IN ? "write" : "read") + "(2): " +
+                 strerror(errno) + ".\n");
+    return -1;
+   }
+  if(eof) eof_bits |= 1u << s;
+  if(this->eof(OUT) && this->eof(ERR)) f_eof = true;
+  return rt;
+}
+//-------------------------------------------------------------------------------------------------
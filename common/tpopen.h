@@ -27,25 +27,115 @@ SOFTWARE.
 #ifndef KIRILLNOW_TPOPEN_H_INCLUDED
 #define KIRILLNOW_TPOPEN_H_INCLUDED
 //-------------------------------------------------------------------------------------------------
-#include <sstream>
 #include <vector>
 #include <string>
+#include <string_view>
+#include <memory>
+#include <iterator>
+#include <cstring>
+#include <algorithm>
+
+/** @brief Growable contiguous byte buffer: filled at the back, consumed from the front.
+ *  @details Data is never moved by consuming, so string_views handed out by getline()
+ *  stay valid until the next prepare() or append().
+ */
+class Tp_buffer
+{
+  std::unique_ptr<char[]> data;
+  size_t cap = 0, head = 0, tail = 0;
+
+public:
+  Tp_buffer() = default;
+  Tp_buffer(std::string_view s) { append(s); }
+  Tp_buffer(Tp_buffer&& r) noexcept { swap(r); }
+  Tp_buffer& operator=(Tp_buffer&& r) noexcept { Tp_buffer{}.swap(*this); swap(r); return *this; }
+
+  void swap(Tp_buffer& o) noexcept
+  {
+      using std::swap; swap(data, o.data); swap(cap, o.cap);
+      swap(head, o.head); swap(tail, o.tail);
+  }
+
+  std::string_view view() const noexcept { return {data.get() + head, tail - head}; }
+  std::string str() const { return std::string(view()); }
+  size_t size() const noexcept { return tail - head; }
+  bool empty() const noexcept { return head == tail; }
+  void clear() noexcept { head = tail = 0; }
+  void consume(size_t n) noexcept { head += std::min(n, size()); if(empty()) clear(); }
+
+  ///Free space for at least n bytes at the back; fill it, then commit().
+  char* prepare(size_t n)
+  {
+    if(tail + n <= cap) return data.get() + tail;
+    const size_t sz = size();
+    if(sz + n <= cap) std::memmove(data.get(), data.get() + head, sz);
+    else
+     {
+      size_t new_cap = std::max({cap * 2, sz + n, size_t(4096)});
+      auto p = std::make_unique_for_overwrite<char[]>(new_cap);
+      if(sz) std::memcpy(p.get(), data.get() + head, sz);
+      data = std::move(p); cap = new_cap;
+     }
+    head = 0; tail = sz;
+    return data.get() + tail;
+  }
+  void commit(size_t n) noexcept { tail += n; }
+  ///Free space at the back.
+  size_t room() const noexcept { return cap - tail; }
+  void append(std::string_view s) { std::memcpy(prepare(s.size()), s.data(), s.size());
+                                    commit(s.size()); }
+
+  /** Take next complete line (without '\n') from the front.
+   *  If at_eof is set, incomplete last line is returned too.
+   */
+  bool getline(std::string_view& line, bool at_eof = false) noexcept
+  {
+    std::string_view v = view();
+    size_t p = v.find('\n');
+    if(p == v.npos && (!at_eof || v.empty())) return false;
+    line = v.substr(0, p);
+    consume(p == v.npos ? v.size() : p + 1);
+    return true;
+  }
+
+  ///Input range of lines for range-for, lines are consumed while iterating.
+  struct line_range
+  {
+    Tp_buffer* b; bool at_eof;
+    struct iterator
+    {
+      Tp_buffer* b; bool at_eof; std::string_view line;
+      iterator& operator++() { if(!b->getline(line, at_eof)) b = nullptr; return *this; }
+      std::string_view operator*() const noexcept { return line; }
+      bool operator==(std::default_sentinel_t) const noexcept { return !b; }
+    };
+    iterator begin() { return ++iterator{b, at_eof, {}}; }
+    std::default_sentinel_t end() const noexcept { return {}; }
+  };
+  ///for(std::string_view l : buf.lines()) ...
+  line_range lines(bool at_eof = true) { return {this, at_eof}; }
+};
+//-------------------------------------------------------------------------------------------------
 
 class Tp_open
 {
   bool  f_opened = false;
   bool  f_eof = false;
+  unsigned char eof_bits = 0;  //per-pipe eof for sync(stream)
   pid_t proc_pid = -1;
+  int   pid_fd = -1;   //pidfd_open(2), -1 if not supported
   int   pipe_in = -1;
   int   pipe_out = -1;
   int   pipe_err = -1;
   int   timeout = 40;  //in ms
-  static constexpr int BUFF_SZ=1024;
+  static constexpr int BUFF_SZ=65536;  //read(2) size
 
 public:
-  std::stringstream s_in;
-  std::stringstream s_out;
-  std::stringstream s_err;
+  enum stream : unsigned char { IN, OUT, ERR };
+
+  Tp_buffer s_in;
+  Tp_buffer s_out;
+  Tp_buffer s_err;
 
   Tp_open(const Tp_open&) = delete;
   Tp_open& operator=(const Tp_open&) = delete;
@@ -63,9 +153,9 @@ public:
 
   void swap(Tp_open& o)
   {
-      using std::swap; swap(proc_pid, o.proc_pid); swap(timeout, o.timeout);
-      swap(f_opened, o.f_opened); swap(f_eof, o.f_eof); swap(pipe_in, o.pipe_in);
-      swap(pipe_out, o.pipe_out); swap(pipe_err, o.pipe_err);
+      using std::swap; swap(proc_pid, o.proc_pid); swap(pid_fd, o.pid_fd); swap(timeout, o.timeout);
+      swap(f_opened, o.f_opened); swap(f_eof, o.f_eof); swap(eof_bits, o.eof_bits);
+      swap(pipe_in, o.pipe_in); swap(pipe_out, o.pipe_out); swap(pipe_err, o.pipe_err);
       s_in.swap(o.s_in); s_out.swap(o.s_out); s_err.swap(o.s_err);
   }
 
@@ -74,13 +164,19 @@ public:
   bool operator!() { return !f_opened; }
   bool eof() { return f_eof; }
   void set_timeout(int timeout_ms) { timeout=timeout_ms; }
+  pid_t pid() const { return proc_pid; }
+  ///Process file descriptor, readable once the process exits; -1 if not supported by kernel.
+  int pidfd() const { return pid_fd; }
+  ///Pipe file descriptor, -1 if closed.
+  int fd(stream s) const { return s == IN ? pipe_in : s == OUT ? pipe_out : pipe_err; }
+  ///Eof reached on single pipe by sync(stream).
+  bool eof(stream s) const { return eof_bits & (1u << s); }
 
   void discard_buffers()
-    { for(auto i : {&s_in, &s_out, &s_err}) {i->str(""); i->clear();} }
+    { for(auto i : {&s_in, &s_out, &s_err}) i->clear(); }
 
   ///Returns what's left unread in error stream.
-  std::string err()
-    { s_err.clear(); return std::string(s_err.str(), s_err.tellg()); }
+  std::string err() { return s_err.str(); }
 
   bool open(const std::vector<std::string> &args)
     { return open(args.front(), args); }
@@ -88,8 +184,19 @@ public:
   bool open(const std::string &executable, const std::vector<std::string> &args);
   int close();
   bool close_0();
+  ///Send signal to opened process (through pidfd if available, so it can't hit a reused pid).
+  bool signal(int sig);
+  ///Wait up to timeout_ms for process exit (the process is not reaped, see close()).
+  bool wait_exit(int timeout_ms);
+  ///SIGTERM, then SIGKILL if process is still running after grace_ms; returns close() status.
+  int terminate(int grace_ms = 2000);
   ///Shuttle data between opened process stdio and s_in, s_out and s_err.
   int sync();
+  /** Shuttle data through single pipe without polling, for use with external event loop
+   *  (the pipe should be ready). Returns number of bytes transferred or -1 on error.
+   *  Sets eof() once both s_out and s_err pipes are closed.
+   */
+  int sync(stream s);
 
 };
 
@@ -43,6 +43,9 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #ifndef CONFIG_FILE_PATH
   #define CONFIG_FILE_PATH "/.config/mount-gui/mount-gui.conf"
 #endif
+#ifndef CACHE_DIR_PATH
+  #define CACHE_DIR_PATH "/.cache/mount-gui"
+#endif
 
 #ifndef SYS_PREF
   #define SYS_PREF      "/usr/bin/"
@@ -57,9 +60,6 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #ifndef BIN_SHOWMOUNT
   #define BIN_SHOWMOUNT SYS_PREF"showmount"
 #endif
-#ifndef BIN_AVAHIB
-  #define BIN_AVAHIB SYS_PREF"avahi-browse"
-#endif
 #ifndef BIN_AFT_MTP
   #define BIN_AFT_MTP SYS_PREF"aft-mtp-mount"
 #endif
@@ -23,15 +23,24 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 //-------------------------------------------------------------------------------------------------
 
 #include "devmap.h"
+#include "sysinfo.h"
 #include "base.h"
 #include "common/execute.h"
 #include "common/glob.h"
 #include "common/tiniline.h"
 #include "common/fmt_op.h"
 #include "common/human_readable.h"
+#include "common/hires_timer.h"
 #include <fstream>
 #include <charconv>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
 #include <fcntl.h>
+#include <sys/inotify.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <libmtp.h>
@@ -39,15 +48,50 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 static constexpr char lsblk_columns[]="NAME,PATH,PKNAME,FSTYPE,SIZE,TYPE,HOTPLUG,"
                                       "RM,LABEL,PARTLABEL,PARTUUID,MODEL,SERIAL,UUID";
 using namespace std;
+using enum device_info::column;
 //-------------------------------------------------------------------------------------------------
 static void add_mtp_devices(device_map& out);
+static void mtp_cache_usb_event(const uevent& e);
 
-device_info devmap_init_columns()
+const std::array<std::string_view, device_info::COLUMNS_N> device_info::column_names
 {
-  return { {"PATH", ""}, {"NAME",  ""}, {"MOUNTPOINT", ""}, {"PARTUUID", ""},
-           {"UUID", ""}, {"LABEL", ""}, {"PARTLABEL",  ""}, {"PKNAME",   ""},
-           {"TYPE", ""}, {"SIZE",  ""}, {"SERIAL",     ""}, {"MODEL",    ""},
-           {"_MTP", ""}, {"RM",    ""}, {"FSTYPE",     ""}, {"_NETDEV",  ""}, };
+  "PATH", "NAME", "MOUNTPOINT", "PARTUUID", "UUID", "LABEL", "PARTLABEL", "PKNAME", "TYPE",
+  "SIZE", "SERIAL", "MODEL", "FSTYPE", "OPTIONS", "RM", "HOTPLUG", "HOST", "IP", "_MTP", "_NETDEV"
+};
+//-------------------------------------------------------------------------------------------------
+
+device_info::column device_info::column_id(std::string_view name) noexcept
+{
+  return column(std::find(column_names.begin(), column_names.end(), name) - column_names.begin());
+}
+//-------------------------------------------------------------------------------------------------
+
+std::string& device_info::operator[](std::string_view name)
+{
+  if(column c = column_id(name); c != COLUMNS_N) return cols[c];
+  if(auto it = extra.find(name); it != extra.end()) return it->second;
+  return extra.emplace(name, string{}).first->second;
+}
+//-------------------------------------------------------------------------------------------------
+
+std::string& device_info::at(std::string_view name)
+{
+  return const_cast<string&>(as_const(*this).at(name));
+}
+//-------------------------------------------------------------------------------------------------
+
+const std::string& device_info::at(std::string_view name) const
+{
+  if(const string* v = find(name)) return *v;
+  throw out_of_range("device_info: no column " + string{name});
+}
+//-------------------------------------------------------------------------------------------------
+
+const std::string* device_info::find(std::string_view name) const noexcept
+{
+  if(column c = column_id(name); c != COLUMNS_N) return &cols[c];
+  auto it = extra.find(name);
+  return it != extra.end() ? &it->second : nullptr;
 }
 //-------------------------------------------------------------------------------------------------
 
@@ -70,7 +114,7 @@ std::string unescape_hex(std::string_view str)
 }
 //-------------------------------------------------------------------------------------------------
 
-bool extract_nameval_pair(const string &str, size_t &pos, string &name, string &value)
+bool extract_nameval_pair(string_view str, size_t &pos, string &name, string &value)
 {
   if(pos == string::npos) return false;
   pos = str.find_first_not_of(" \t\r\n", pos);
@@ -118,111 +162,360 @@ static pair<string,string> split_netdev_path(const string& path)
 }
 //-------------------------------------------------------------------------------------------------
 
-static bool add_mount_options_and_netdevs(device_map& dmap)
+static void add_mount_options_and_netdevs(device_map& dmap, const mountinfo_table& mi)
 {
-  stringstream s_out;
-  if(execute({SYS_PREF"findmnt", "-UPo", "SOURCE,SIZE,FSTYPE,TARGET,OPTIONS"}, s_out))
-    return false;
-
-  string line, name, val, src, sz, fstype, tgt, opt;
-  pair<string*, string_view> tie[] =
-   { {&src, "SOURCE"}, {&sz, "SIZE"}, {&fstype, "FSTYPE"}, {&tgt, "TARGET"}, {&opt, "OPTIONS"} };
-  while(getline(s_out, line))
+  //same as `findmnt -U`: skip filesystems hidden under the same target
+  vector<bool> hidden(mi.entries.size());
+  unordered_set<string_view> targets;
+  for(size_t i = mi.entries.size(); i-- > 0;)
+    hidden[i] = !targets.insert(mi.entries[i].target).second;
+
+  device_index idx{dmap};
+  unordered_set<string> mounted_mtp;
+  string src, opt;
+  for(size_t i = 0; i < mi.entries.size(); ++i)
    {
-    for(size_t pos = 0; extract_nameval_pair(line, pos, name, val);)
-      for(auto& t : tie)
-        if(t.second == name) *t.first = unescape_hex(val);
+    if(hidden[i]) continue;
+    const mountinfo_entry& m = mi.entries[i];
+    src = m.source; opt = m.options();
+    const bool netdev = is_netdev(src, m.fstype, opt);
+    if(!netdev && m.root != "/") src.append(1, '[').append(m.root).append(1, ']'); //as findmnt
 
-    if(device_info* d = find_device(dmap, src))
+    if(device_info* d = idx.find(dmap, src))
      {
-      (*d)["MOUNTPOINT"] = std::move(tgt); (*d)["OPTIONS"] = std::move(opt);
+      (*d)[MOUNTPOINT] = m.target; (*d)[OPTIONS] = std::move(opt);
      }
-    else if(is_netdev(src, fstype, opt))
+    else if(netdev)
      {
-      auto &dev = (dmap.emplace_back(devmap_init_columns()), dmap.back());
+      auto &dev = (dmap.emplace_back(), dmap.back());
       auto [srvr, shr] = split_netdev_path(src);
       for(char& c : shr) if(c == '\\') c = '/';
-      dev["SIZE"]    = std::move(sz);  dev["FSTYPE"]     = std::move(fstype);
-      dev["OPTIONS"] = std::move(opt); dev["MOUNTPOINT"] = std::move(tgt);
-      dev["NAME"]    = std::move(shr); dev["PATH"]       = std::move(src);
-      dev["_NETDEV"] = "1";            dev["PKNAME"]     = std::move(srvr);
+      dev[MOUNTPOINT] = m.target;        dev[FSTYPE] = m.fstype;
+      dev[OPTIONS]    = std::move(opt);
+      dev[NAME]       = std::move(shr);  dev[PATH]   = std::move(src);
+      dev[NETDEV]     = "1";             dev[PKNAME] = std::move(srvr);
+      idx.add(dmap, dmap.size() - 1);
      }
-    else if(starts_with(fstype, "fuse.") && fstype.find("mtp", 5) != string::npos)
+    else if(starts_with(m.fstype, "fuse.") && m.fstype.find("mtp", 5) != string::npos)
      {
-      auto &dev = (dmap.emplace_back(devmap_init_columns()), dmap.back());
-      if(auto [l,r,s] = split2v(src, ':'); s && starts_with(l, "/dev/bus/usb"))
-       { dev["PATH"] = l; dev["NAME"] = unescape_hex(r); }
-      else { dev["PATH"] = dev["NAME"] = std::move(src); }
-
-      dev["SIZE"]    = std::move(sz);  dev["FSTYPE"]     = std::move(fstype);
-      dev["OPTIONS"] = std::move(opt); dev["MOUNTPOINT"] = std::move(tgt);
-      dev["_MTP"]    = "*";
+      auto &dev = (dmap.emplace_back(), dmap.back());
+      if(auto [l,r,s] = split2v(m.source, ':'); s && starts_with(l, "/dev/bus/usb"))
+       { dev[PATH] = l; dev[NAME] = unescape_hex(r); }
+      else { dev[PATH] = dev[NAME] = std::move(src); }
+
+      dev[MOUNTPOINT] = m.target;        dev[FSTYPE] = m.fstype;
+      dev[OPTIONS]    = std::move(opt);  dev[MTP]    = "*";
+      idx.add(dmap, dmap.size() - 1);
+      mounted_mtp.insert(dev[PATH]);
      }
    }
-  return true;
+  //mounted MTP device is busy, only its mount is shown (cached row would stay otherwise)
+  erase_if(dmap, [&](device_info& d)
+           { return d[MTP].size() && d[MTP] != "*" && mounted_mtp.count(d[PATH]); });
 }
 //-------------------------------------------------------------------------------------------------
 
-static void add_preconfigured_netdevs(device_map& dmap, const mount_db db)
+static void add_preconfigured_netdevs(device_map& dmap, const mount_db& db)
 {
+  device_index idx{dmap};
   for(auto& mu : db)
-    if(mu.what_sel == mount_unit::PATH && !find_device(dmap, mu.what) &&
+    if(mu.what_sel == mount_unit::PATH && !idx.find(dmap, mu.what) &&
        is_netdev(mu.what, mu.fstype, mu.options))
      {
-      auto &dev = (dmap.emplace_back(devmap_init_columns()), dmap.back());
+      auto &dev = (dmap.emplace_back(), dmap.back());
       auto [srvr, shr] = split_netdev_path(mu.what);
       for(char& c : shr) if(c == '\\') c = '/';
-      dev["OPTIONS"] = mu.options; dev["FSTYPE"] = mu.fstype;
-      dev["PATH"]    = mu.what;    dev["NAME"]   = std::move(shr);
-      dev["_NETDEV"] = "1";        dev["PKNAME"] = std::move(srvr);
+      dev[OPTIONS] = mu.options; dev[FSTYPE] = mu.fstype;
+      dev[PATH]    = mu.what;    dev[NAME]   = std::move(shr);
+      dev[NETDEV]  = "1";        dev[PKNAME] = std::move(srvr);
+      idx.add(dmap, dmap.size() - 1);
      }
 }
 //-------------------------------------------------------------------------------------------------
 
-device_map system_scan_devices(const mount_db& system_db)
+///Show non-removable hotplug disks as "USB".
+static void mark_usb_disk(device_info& dev)
 {
+  if(dev[RM] == "0" && dev[HOTPLUG] == "1") dev[RM] = "USB";
+}
+//-------------------------------------------------------------------------------------------------
+
+static bool lsblk_scan_devices(device_map& out)
+{
+  string name, value;
   device_map res;
-  stringstream s_out;
-  if(execute({SYS_PREF"lsblk", "-nPo", lsblk_columns}, s_out))
-    return res;
+  if(execute_lines({SYS_PREF"lsblk", "-nPo", lsblk_columns}, [&](string_view line)
+   {
+    auto &dev = (res.emplace_back(), res.back());
+    for(size_t pos = 0; extract_nameval_pair(line, pos, name, value);)
+      dev[name] = unescape_hex(value);
+   }))
+    return false;
+  out.insert(out.end(), make_move_iterator(res.begin()), make_move_iterator(res.end()));
+  return true;
+}
+//-------------------------------------------------------------------------------------------------
+
+bool save_device_list(const device_map& dmap, const std::string& path)
+{
+  ofstream file(path, ios::out|ios::trunc);
+  string line;
+  for(const device_info& d : dmap)
+   {
+    line.clear();
+    d.for_each([&](string_view col, const string& val)
+     {
+      if(val.empty()) return;
+      if(line.size()) line += ' ';
+      line.append(col).append("=\"");
+      for(unsigned char c : val) //same escaping as lsblk -P
+        if(c < 0x20 || c == 0x7f || c == '"' || c == '\\') line += "\\x{:02x}" % $(c);
+        else line += c;
+      line += '"';
+     });
+    file << line << '\n';
+   }
+  file.close();
+  if(!file) log("Failed to write '" + path + "'.", "orange");
+  return bool(file);
+}
+//-------------------------------------------------------------------------------------------------
 
-  string line, name, value;
-  while(getline(s_out, line))
+device_map load_device_list(const std::string& path)
+{
+  device_map res;
+  ifstream file(path);
+  string name, value;
+  for(string line; getline(file, line);)
    {
-    res.emplace_back(devmap_init_columns());
-    auto &dev = res.back();
+    device_info& dev = res.emplace_back();
     for(size_t pos = 0; extract_nameval_pair(line, pos, name, value);)
       dev[name] = unescape_hex(value);
+    if(dev[PATH].empty()) res.pop_back();
+   }
+  return res;
+}
+//-------------------------------------------------------------------------------------------------
 
-    if(dev["RM"] == "0" && dev["HOTPLUG"] == "1") dev["RM"] = "USB";
+///Log all differences between sysfs and lsblk scan results.
+static void compare_device_scans(device_map& sysfs, device_map& lsblk)
+{
+  int diffs = 0;
+  const device_index sysfs_idx{sysfs}, lsblk_idx{lsblk};
+  for(auto& l : lsblk)
+   {
+    const string& path = l.at(PATH);
+    device_info* s = sysfs_idx.find(sysfs, path);
+    if(!s) { log("DeviceScan: " + path + " was not found in sysfs.", "orange"); ++diffs; continue; }
+    l.for_each([&](string_view col, const string& val)
+     {
+      if(const string* sv = s->find(col); sv && *sv != val)
+       {
+        log("DeviceScan: " + path + ' ' + string{col} + "=\"" + *sv +
+            "\" (sysfs) != \"" + val + "\" (lsblk)", "orange");
+        ++diffs;
+       }
+     });
    }
-  add_mtp_devices(res);
-  add_mount_options_and_netdevs(res);
-  add_preconfigured_netdevs(res, system_db);
+  for(auto& s : sysfs)
+    if(!lsblk_idx.find(lsblk, s.at(PATH)))
+     { log("DeviceScan: " + s.at(PATH) + " was not found by lsblk.", "orange"); ++diffs; }
+  log("DeviceScan: " + to_string(diffs) + " difference(s) between sysfs and lsblk.", "");
+}
+//-------------------------------------------------------------------------------------------------
+
+static device_map scan_block_devices(std::string_view method)
+{
+  device_map res, cmp;
+  if(method == "lsblk") lsblk_scan_devices(res);
+  else if(!sysfs_scan_devices(res))
+   {
+    log("Failed to read /sys/class/block, falling back to lsblk.");
+    res.clear(); lsblk_scan_devices(res);
+   }
+  else if(method == "compare" && lsblk_scan_devices(cmp))
+    compare_device_scans(res, cmp);
+
+  for(auto& dev : res) mark_usb_disk(dev);
   return res;
 }
 //-------------------------------------------------------------------------------------------------
 
-mount_db scan_systemd_units()
+///Run fn() on a new thread, the result is paired with its run time.
+template<class F> static auto async_timed(F fn)
 {
-  //`systemd-analyze unit-paths`; order matters
-  auto mu = {"/etc/systemd/system.control/*.mount", "/run/systemd/system.control/*.mount",
-             "/run/systemd/transient/*.mount",      "/run/systemd/generator.early/*.mount",
-             "/etc/systemd/system/*.mount",         "/etc/systemd/system.attached/*.mount",
-             "/run/systemd/system/*.mount",         "/run/systemd/system.attached/*.mount",
-             "/run/systemd/generator/*.mount",      "/usr/local/lib/systemd/system/*.mount",
-           /*"/usr/lib/systemd/system/ *.mount",*/  "/run/systemd/generator.late/*.mount",  };
-  mount_db res;
-  for(char* p : glob(mu))
+  return async(launch::async, [fn = std::move(fn)]
+               { hires_timer t; auto r = fn(); return pair{std::move(r), t.microseconds()}; });
+}
+//-------------------------------------------------------------------------------------------------
+
+///Wait for future, keeping GUI responsive (as execute() does).
+template<class T> static T get_result(future<T>& f)
+{
+  while(f.wait_for(40ms) != future_status::ready) refresh_ui();
+  return f.get();
+}
+//-------------------------------------------------------------------------------------------------
+
+system_snapshot system_scan(std::string_view method, bool with_mtp)
+{
+  hires_timer total;
+  //independent sources, merged below in fixed order
+  auto f_units  = async_timed([] { return scan_systemd_units(); });
+  auto f_blocks = async_timed([m = string{method}] { return scan_block_devices(m); });
+  auto f_mtp    = async_timed([with_mtp] { return with_mtp ? scan_mtp_devices() : device_map{}; });
+  auto f_mounts = async_timed([]
+   {
+    auto mi = make_unique<mountinfo_table>();
+    if(!mi->read()) mi.reset();
+    return mi;
+   });
+
+  system_snapshot res;
+  auto [blocks, t_blocks] = get_result(f_blocks);
+  auto [mtp,    t_mtp]    = get_result(f_mtp);
+  auto [mounts, t_mounts] = get_result(f_mounts);
+  int64_t t_units;
+  tie(res.units, t_units) = get_result(f_units);
+
+  hires_timer merge;
+  res.devices = std::move(blocks);
+  res.devices.insert(res.devices.end(), make_move_iterator(mtp.begin()),
+                                        make_move_iterator(mtp.end()));
+  if(mounts) add_mount_options_and_netdevs(res.devices, *mounts);
+  add_preconfigured_netdevs(res.devices, res.units);
+
+  auto ms = [](int64_t us) { return us / 1000.0; };
+  log("Refresh: units {:.1f} ms, block devices {:.1f} ms, MTP {:.1f} ms, mounts {:.1f} ms, "
+      "merge {:.1f} ms, total {:.1f} ms." % $(ms(t_units), ms(t_blocks), ms(t_mtp), ms(t_mounts),
+                                              ms(merge.microseconds()), ms(total.microseconds())),
+      "");
+  return res;
+}
+//-------------------------------------------------------------------------------------------------
+
+bool update_mounts(device_map& dmap, const mount_db& system_db,
+                   std::vector<device_info*>& changed)
+{
+  //rows that came from mount table are rebuilt, all other rows just lose mount state
+  device_map upd; upd.reserve(dmap.size());
+  for(auto& d : dmap)
+    if(d[NETDEV].empty() && d[MTP] != "*")
+     { auto& u = upd.emplace_back(d); u[MOUNTPOINT].clear(); u[OPTIONS].clear(); }
+
+  mountinfo_table mi;
+  if(!mi.read()) return false;
+  add_mount_options_and_netdevs(upd, mi);
+  add_preconfigured_netdevs(upd, system_db);
+
+  bool same = (upd.size() == dmap.size());
+  for(size_t i = 0; same && i < upd.size(); ++i) same = (upd[i][PATH] == dmap[i][PATH]);
+  if(!same) { dmap = std::move(upd); return true; }
+
+  //SIZE of mounted shares is filled in later (statvfs could hang), keep it unless remounted
+  for(size_t i = 0; i < upd.size(); ++i)
    {
-    if(struct stat st{}; lstat(p, &st) || S_ISLNK(st.st_mode)) continue;
-    if(mount_unit unit{}; read_systemd_unit(p, unit))
-      res.emplace_back(std::move(unit));
+    bool ch = false;
+    for(auto col : {MOUNTPOINT, OPTIONS})
+      if(string &o = dmap[i][col], &n = upd[i][col]; o != n) { o = std::move(n); ch = true; }
+    if(ch) { dmap[i][SIZE] = std::move(upd[i][SIZE]); changed.push_back(&dmap[i]); }
    }
+  return false;
+}
+//-------------------------------------------------------------------------------------------------
+
+///Rows of block devices go first, followed by MTP devices and network shares.
+static device_map::iterator block_devices_end(device_map& dmap)
+{
+  return find_if(dmap.begin(), dmap.end(), [](device_info& d)
+                 { return d[MTP].size() || d[NETDEV].size(); });
+}
+//-------------------------------------------------------------------------------------------------
+
+///Insert new block device after its parent and siblings (lsblk order).
+static void insert_block_device(device_map& dmap, device_info&& dev)
+{
+  auto pos = block_devices_end(dmap);
+  if(const string& pk = dev[PKNAME]; pk.size())
+    if(auto p = find_if(dmap.begin(), pos, [&](device_info& d) { return d[PATH] == "/dev/" + pk; });
+       p != pos)
+      for(pos = p + 1; pos != dmap.end() && (*pos)[PKNAME] == pk; ++pos);
+  dmap.insert(pos, std::move(dev));
+}
+//-------------------------------------------------------------------------------------------------
+
+device_map scan_mtp_devices()
+{
+  device_map res;
+  add_mtp_devices(res);
   return res;
 }
 //-------------------------------------------------------------------------------------------------
 
+void update_mtp_rows(device_map& dmap, device_map mtp)
+{
+  //mounted MTP device is busy, only its mount is shown (as in add_mount_options_and_netdevs)
+  erase_if(mtp, [&](device_info& m) { return ranges::any_of(dmap, [&](device_info& d)
+                                      { return d[MTP] == "*" && d[PATH] == m[PATH]; }); });
+  auto is_mtp = [](device_info& d) { const string& m = d[MTP]; return m.size() && m != "*"; };
+  auto pos = find_if(dmap.begin(), dmap.end(), is_mtp);
+  if(pos == dmap.end()) pos = block_devices_end(dmap);
+  size_t at = pos - dmap.begin();
+  dmap.erase(remove_if(pos, dmap.end(), is_mtp), dmap.end());
+  dmap.insert(dmap.begin() + at, make_move_iterator(mtp.begin()), make_move_iterator(mtp.end()));
+}
+//-------------------------------------------------------------------------------------------------
+
+bool apply_uevents(device_map& dmap, const mount_db& system_db,
+                   const std::vector<uevent>& events, bool& mtp_changed)
+{
+  bool changed = false;
+  mtp_changed = false;
+  for(const uevent& e : events)
+   {
+    if(e.subsystem == "usb" && e.devtype == "usb_device" &&
+       (e.action == "add" || e.action == "remove"))
+     { mtp_cache_usb_event(e); mtp_changed = true; continue; }
+    if(e.subsystem != "block") continue;
+
+    string kname = filename(e.devpath), path = kname;
+    replace(path.begin(), path.end(), '!', '/');
+    path = e.dm_name.empty() ? "/dev/" + path : "/dev/mapper/" + e.dm_name;
+    auto it = find_if(dmap.begin(), dmap.end(), [&](device_info& d) { return d[PATH] == path; });
+    if(e.action == "remove")
+     {
+      if(it != dmap.end()) { dmap.erase(it); changed = true; }
+      continue;
+     }
+    if(e.action != "add" && e.action != "change") continue;
+
+    device_info dev;
+    if(!sysfs_read_device(kname, dev))
+     {
+      //e.g. loop device was detached and now has zero size
+      if(it != dmap.end()) { dmap.erase(it); changed = true; }
+      continue;
+     }
+    mark_usb_disk(dev);
+    if(dev[PATH] != path) //dm device without DM_NAME in event
+      it = find_if(dmap.begin(), dmap.end(), [&](device_info& d) { return d[PATH] == dev[PATH]; });
+    if(it != dmap.end())
+     {
+      for(auto col : {MOUNTPOINT, OPTIONS}) dev[col] = (*it)[col];
+      if(dev == *it) continue;
+      *it = std::move(dev);
+     }
+    else insert_block_device(dmap, std::move(dev));
+    changed = true;
+   }
+
+  //device could be mounted before its event was applied
+  vector<device_info*> mounts;
+  if(changed) update_mounts(dmap, system_db, mounts);
+  return changed;
+}
+//-------------------------------------------------------------------------------------------------
+
 static string resolve_dev_link(const string& src)
 {
   ssize_t l; char b[128]{};
@@ -232,7 +525,15 @@ static string resolve_dev_link(const string& src)
 }
 //-------------------------------------------------------------------------------------------------
 
-bool read_systemd_unit(const std::string &path, mount_unit &out)
+///Device path in What= is resolved on use, /dev/disk links change on hotplug.
+static bool what_is_path(const mount_unit& u)
+{
+  return u.what_sel == mount_unit::PATH || u.what_sel == mount_unit::INV_SEL;
+}
+//-------------------------------------------------------------------------------------------------
+
+///Read unit file without resolving /dev/disk links in What=
+static bool parse_systemd_unit(const std::string &path, mount_unit &out)
 {
   Tini_line ini;
   bool mount_section = false;
@@ -255,7 +556,7 @@ bool read_systemd_unit(const std::string &path, mount_unit &out)
        { if(s == l2.name) { out.what = std::move(l2.value); break; } out.what_sel++; }
       if(out.what_sel < mount_unit::INV_SEL) continue;
      }
-    out.what = resolve_dev_link(ini.value);
+    out.what = std::move(ini.value);
    }
   if(out.what.empty() || out.where.empty()) return false;
   out.unit_path = path;
@@ -263,31 +564,215 @@ bool read_systemd_unit(const std::string &path, mount_unit &out)
 }
 //-------------------------------------------------------------------------------------------------
 
+bool read_systemd_unit(const std::string &path, mount_unit &out)
+{
+  if(!parse_systemd_unit(path, out)) return false;
+  if(what_is_path(out)) out.what = resolve_dev_link(out.what);
+  return true;
+}
+//-------------------------------------------------------------------------------------------------
+
+namespace {
+///Parsed unit file, valid while inode and mtime are the same.
+struct unit_cache_entry
+{
+  ino_t    ino;
+  timespec mtime;
+  bool     valid;
+  mount_unit unit;
+};
+
+/** Units from the last scan_systemd_units().
+ *  Unit directories are watched with inotify: while nothing there changes, the last
+ *  result is reused without even listing directories.
+ */
+struct
+{
+  mutex lock;
+  int  fd = -1;               ///<inotify
+  bool init = false, dirty = true;
+  unordered_map<int, string> watches;  ///<watch descriptor -> directory
+  unordered_map<string, unit_cache_entry> units;
+  vector<const unit_cache_entry*> last; ///<result of last scan, in scan order
+} unit_cache;
+}
+//-------------------------------------------------------------------------------------------------
+
+///Watch directories that exist now, drain inotify queue; true if anything changed.
+static bool unit_dirs_changed(const vector<string>& dirs)
+{
+  auto& uc = unit_cache;
+  if(!uc.init)
+   {
+    uc.init = true;
+    if((uc.fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC)) < 0)
+      log("inotify_init1(): " + s_errno() + ", systemd units will be re-read on every refresh.",
+          "orange");
+   }
+  if(uc.fd < 0) return true;
+
+  bool changed = false;
+  for(const string& d : dirs)
+   {
+    if(ranges::find_if(uc.watches, [&](auto& w) { return w.second == d; }) != uc.watches.end())
+      continue;
+    if(!exists(d)) continue;
+    constexpr uint32_t mask = IN_CREATE|IN_DELETE|IN_CLOSE_WRITE|IN_MODIFY|IN_ATTRIB|
+                              IN_MOVED_FROM|IN_MOVED_TO|IN_DELETE_SELF|IN_MOVE_SELF|IN_ONLYDIR;
+    if(int wd = inotify_add_watch(uc.fd, d.c_str(), mask); wd >= 0)
+      { uc.watches[wd] = d; changed = true; } //new directory
+    else return true;
+   }
+
+  alignas(inotify_event) char buff[4096];
+  for(ssize_t n; (n = read(uc.fd, buff, sizeof(buff))) != 0;)
+   {
+    if(n < 0) { if(errno == EINTR) continue; if(errno == EAGAIN) break; return true; }
+    changed = true;
+    for(char* p = buff; p < buff + n;)
+     {
+      auto* ev = (inotify_event*)p;
+      if(ev->mask & IN_IGNORED) uc.watches.erase(ev->wd); //directory was removed
+      p += sizeof(inotify_event) + ev->len;
+     }
+   }
+  return changed;
+}
+//-------------------------------------------------------------------------------------------------
+
+mount_db scan_systemd_units()
+{
+  //`systemd-analyze unit-paths`; order matters
+  static const vector<string> dirs =
+   { "/etc/systemd/system.control",     "/run/systemd/system.control",
+     "/run/systemd/transient",          "/run/systemd/generator.early",
+     "/etc/systemd/system",             "/etc/systemd/system.attached",
+     "/run/systemd/system",             "/run/systemd/system.attached",
+     "/run/systemd/generator",          "/usr/local/lib/systemd/system",
+   /*"/usr/lib/systemd/system",*/       "/run/systemd/generator.late", };
+  auto& uc = unit_cache;
+  lock_guard lock{uc.lock};
+  uc.dirty |= unit_dirs_changed(dirs);
+
+  if(uc.dirty)
+   {
+    static const vector<string> patterns = [] {
+      vector<string> r;
+      for(const string& d : dirs) r.push_back(d + "/*.mount");
+      return r; }();
+    uc.dirty = false;
+    vector<string> order;
+    unordered_map<string, unit_cache_entry> units;
+    for(char* p : glob(patterns))
+     {
+      struct stat st{};
+      if(lstat(p, &st) || S_ISLNK(st.st_mode) || units.contains(p)) continue;
+      auto& e = units[p];
+      auto it = uc.units.find(p);
+      if(it != uc.units.end() && it->second.ino == st.st_ino &&
+         it->second.mtime.tv_sec == st.st_mtim.tv_sec &&
+         it->second.mtime.tv_nsec == st.st_mtim.tv_nsec)
+        e = std::move(it->second);
+      else
+       {
+        e = {st.st_ino, st.st_mtim, false, {}};
+        e.valid = parse_systemd_unit(p, e.unit);
+       }
+      order.emplace_back(p);
+     }
+    uc.units = std::move(units);
+    uc.last.clear();
+    for(const string& p : order)
+      if(const auto& e = uc.units.at(p); e.valid) uc.last.push_back(&e);
+   }
+
+  mount_db res;
+  res.reserve(uc.last.size());
+  for(const unit_cache_entry* e : uc.last)
+   {
+    mount_unit& u = res.emplace_back(e->unit);
+    if(what_is_path(u)) u.what = resolve_dev_link(u.what);
+   }
+  res.reindex();
+  return res;
+}
+//-------------------------------------------------------------------------------------------------
+
+void mount_db::reindex()
+{
+  where_idx.clear();
+  for(auto& i : what_idx) i.clear();
+  for(size_t n = 0; n < size(); ++n)
+   {
+    const mount_unit& mu = (*this)[n];
+    where_idx.try_emplace(mu.where, n);
+    if(mu.what_sel >= 0 && mu.what_sel < mount_unit::INV_SEL)
+      what_idx[mu.what_sel].try_emplace(mu.what, n);
+   }
+}
+//-------------------------------------------------------------------------------------------------
+
+mount_unit* mount_db::find_where(const std::string& where)
+{
+  auto it = where_idx.find(where);
+  return (it != where_idx.end() && it->second < size()) ? &(*this)[it->second] : nullptr;
+}
+//-------------------------------------------------------------------------------------------------
+
+mount_unit* mount_db::find_what(int sel, const std::string& what)
+{
+  if(sel < 0 || sel >= mount_unit::INV_SEL) return nullptr;
+  auto it = what_idx[sel].find(what);
+  return (it != what_idx[sel].end() && it->second < size()) ? &(*this)[it->second] : nullptr;
+}
+//-------------------------------------------------------------------------------------------------
+
+void device_index::rebuild(const device_map& dmap)
+{
+  by_path.clear();
+  by_path.reserve(dmap.size());
+  for(size_t n = 0; n < dmap.size(); ++n) add(dmap, n);
+}
+//-------------------------------------------------------------------------------------------------
+
+device_info* device_index::find(device_map& dmap, const std::string& path) const
+{
+  auto it = by_path.find(path);
+  if(it == by_path.end() || it->second >= dmap.size()) return nullptr;
+  device_info& d = dmap[it->second];
+  return d[PATH] == path ? &d : find_device(dmap, path); //stale index is a bug, but not fatal
+}
+//-------------------------------------------------------------------------------------------------
+
 mount_unit* find_mount_unit(mount_db &db, const std::string &mountpoint)
 {
-  for(auto& mu : db) { if(mu.where == mountpoint) return &mu; } return nullptr;
+  return db.find_where(mountpoint);
 }
 //-------------------------------------------------------------------------------------------------
 
 mount_unit* find_mount_unit(mount_db &db, const mount_info &info)
 {
-  const string* tie[] = {&info.path, info.dev ? &info.dev->at("LABEL") : 0,
-                                     info.dev ? &info.dev->at("UUID")  : 0,
-                                     info.dev ? &info.dev->at("PARTLABEL") : 0,
-                                     info.dev ? &info.dev->at("PARTUUID")  : 0};
+  const string* tie[] = {&info.path, info.dev ? &info.dev->at(LABEL) : 0,
+                                     info.dev ? &info.dev->at(UUID)  : 0,
+                                     info.dev ? &info.dev->at(PARTLABEL) : 0,
+                                     info.dev ? &info.dev->at(PARTUUID)  : 0};
   mount_unit* mu = find_mount_unit(db, info.target);
-  return (mu && tie[mu->what_sel] && mu->what == *tie[mu->what_sel]) ? mu : nullptr;
+  return (mu && mu->what_sel < mount_unit::INV_SEL && tie[mu->what_sel] &&
+          mu->what == *tie[mu->what_sel]) ? mu : nullptr;
 }
 //-------------------------------------------------------------------------------------------------
 
 mount_unit* find_mount_unit(mount_db &db, const device_info &dev)
 {
-  const string* tie[] = {&dev.at("PATH"), &dev.at("LABEL"),  &dev.at("UUID"),
-                         &dev.at("PARTLABEL"), &dev.at("PARTUUID")};
-  for(auto& mu : db)
-    if(tie[mu.what_sel] && mu.what == *tie[mu.what_sel])
-      return &mu;
-  return nullptr;
+  const string* tie[] = {&dev.at(PATH), &dev.at(LABEL),  &dev.at(UUID),
+                         &dev.at(PARTLABEL), &dev.at(PARTUUID)};
+  //the first matching unit, whatever selector it uses
+  mount_unit* res = nullptr;
+  for(int sel = mount_unit::PATH; sel < mount_unit::INV_SEL; ++sel)
+    if(mount_unit* mu = tie[sel]->empty() ? nullptr : db.find_what(sel, *tie[sel]);
+       mu && (!res || mu < res))
+      res = mu;
+  return res;
 }
 //-------------------------------------------------------------------------------------------------
 
@@ -306,65 +791,171 @@ bool is_netdev(std::string_view path, std::string_view fstype, std::string_view
 }
 //-------------------------------------------------------------------------------------------------
 
-static void add_mtp_devices(device_map& out)
+namespace {
+///Detected MTP device, reused until its USB device is removed.
+struct mtp_cache_entry
+{
+  LIBMTP_raw_device_t raw;
+  device_info info;
+
+  bool same_device(const LIBMTP_raw_device_t& r) const noexcept
+   {
+    return raw.bus_location == r.bus_location && raw.devnum == r.devnum &&
+           raw.device_entry.vendor_id  == r.device_entry.vendor_id &&
+           raw.device_entry.product_id == r.device_entry.product_id;
+   }
+};
+
+struct
+{
+  mutex libmtp;             ///<serializes libmtp calls
+  mutex data;               ///<guards members below
+  bool hotplug  = false;    ///<USB uevents are delivered, see mtp_cache_enable()
+  bool detected = false;    ///<devices are current
+  unsigned generation = 0;  ///<incremented when USB device is added
+  vector<mtp_cache_entry> devices;
+} mtp_cache;
+}
+//-------------------------------------------------------------------------------------------------
+
+///Open MTP device and read its name and storage capacity (libmtp lock must be held).
+static bool read_mtp_device(LIBMTP_raw_device_t& raw, device_info& r)
+{
+  LIBMTP_mtpdevice_t* dev = LIBMTP_Open_Raw_Device_Uncached(&raw);
+  if(!dev) return false;
+
+  auto mks = [](char* s){ string t; if(s) { t = s; LIBMTP_FreeMemory(s); } return t; };
+
+  r[NAME]   = mks(LIBMTP_Get_Friendlyname(dev));
+  string &model  = r[MODEL]  = mks(LIBMTP_Get_Modelname(dev)),
+         &serial = r[SERIAL] = mks(LIBMTP_Get_Serialnumber(dev));
+
+  r[PATH]    = "/dev/bus/usb/{:03d}/{:03d}" % $(raw.bus_location, raw.devnum);
+  r["_JMTP"] = "{},{}"                      % $(raw.bus_location, raw.devnum);
+  #ifndef AFT_MTP_BEFORE_20230722
+    r["_AMTP"] = "{:x}:{:x}" % $(raw.device_entry.vendor_id, raw.device_entry.product_id);
+  #else
+    string &amtp = r["_AMTP"] = serial.empty() ? model : serial;
+    auto pred = [](unsigned char c) { return isspace(c); };
+    amtp.erase(remove_if(amtp.begin(), amtp.end(), pred), amtp.end());
+  #endif
+  //TODO: Generate UUID
+
+  uint64_t st_size = 0, st_free = 0;
+  for(LIBMTP_devicestorage_t* st = dev->storage; st; st = st->next)
+   { st_size += st->MaxCapacity; st_free += st->FreeSpaceInBytes; }
+
+  if(st_size && st_free <= st_size)
+   {
+    r[SIZE]      = human_readable_b(st_size, false);
+    r["FSAVAIL"] = human_readable_b(st_free, false);
+    r["FSUSED"]  = human_readable_b(st_size - st_free, false);
+    r["FSUSE%"]  = to_string((st_size - st_free) * 100 / st_size) + "%";
+   }
+  LIBMTP_Dump_Errorstack(dev);
+  LIBMTP_Clear_Errorstack(dev);
+  LIBMTP_Release_Device(dev);
+  return true;
+}
+//-------------------------------------------------------------------------------------------------
+
+///Detect MTP devices, only new ones are opened.
+static vector<mtp_cache_entry> detect_mtp_devices()
 {
+  if(!usb_mtp_interface_present()) return {}; //libmtp is not even initialized
+  lock_guard lock{mtp_cache.libmtp};
   static int _init = (LIBMTP_Init(), 1);
   LIBMTP_raw_device_t* rds = nullptr;
   int rds_n = 0;
   switch(LIBMTP_Detect_Raw_Devices(&rds, &rds_n))
    {
     case LIBMTP_ERROR_NONE: break;
-    case LIBMTP_ERROR_NO_DEVICE_ATTACHED:                                return;
-    case LIBMTP_ERROR_PTP_LAYER:    log("Libmtp: PTP layer error.");     return;
-    case LIBMTP_ERROR_USB_LAYER:    log("Libmtp: USB layer error.");     return;
-    case LIBMTP_ERROR_MEMORY_ALLOCATION: log("Libmtp: Memory allocation failed."); return;
-    case LIBMTP_ERROR_STORAGE_FULL: log("Libmtp: Storage is full.");     return;
-    case LIBMTP_ERROR_CONNECTING:   log("Libmtp: Connection error.");    return;
-    case LIBMTP_ERROR_CANCELLED:    log("Libmtp: Operation cancelled."); return;
-    default:                        log("Libmtp: Unknown error.");       return;
+    case LIBMTP_ERROR_NO_DEVICE_ATTACHED:                                return {};
+    case LIBMTP_ERROR_PTP_LAYER:    log("Libmtp: PTP layer error.");     return {};
+    case LIBMTP_ERROR_USB_LAYER:    log("Libmtp: USB layer error.");     return {};
+    case LIBMTP_ERROR_MEMORY_ALLOCATION: log("Libmtp: Memory allocation failed."); return {};
+    case LIBMTP_ERROR_STORAGE_FULL: log("Libmtp: Storage is full.");     return {};
+    case LIBMTP_ERROR_CONNECTING:   log("Libmtp: Connection error.");    return {};
+    case LIBMTP_ERROR_CANCELLED:    log("Libmtp: Operation cancelled."); return {};
+    default:                        log("Libmtp: Unknown error.");       return {};
    }
+  vector<mtp_cache_entry> res;
   for(int i = 0; i < rds_n; ++i)
    {
-    LIBMTP_mtpdevice_t* dev = LIBMTP_Open_Raw_Device_Uncached(&rds[i]);
-    if(!dev) { /*log("Failed to open MTP Device #" + to_string(i + 1));*/ continue; }
-
-    device_info &r = (out.emplace_back(devmap_init_columns()), out.back());
-
-    auto mks = [](char* s){ string t; if(s) { t = s; LIBMTP_FreeMemory(s); } return t; };
-
-    string &name   = r["NAME"]   = mks(LIBMTP_Get_Friendlyname(dev)),
-           &model  = r["MODEL"]  = mks(LIBMTP_Get_Modelname(dev)),
-           &serial = r["SERIAL"] = mks(LIBMTP_Get_Serialnumber(dev));
-
-    if(name.empty()) name = "MTP#" + to_string(i + 1);
-    r["_MTP"]  = to_string(i + 1);
-    r["PATH"]  = "/dev/bus/usb/{:03d}/{:03d}" % $(rds[i].bus_location, rds[i].devnum);
-    r["_JMTP"] = "{},{}"                      % $(rds[i].bus_location, rds[i].devnum);
-    #ifndef AFT_MTP_BEFORE_20230722
-      r["_AMTP"] = "{:x}:{:x}" % $(rds[i].device_entry.vendor_id,
-                                   rds[i].device_entry.product_id);
-    #else
-      string &amtp = r["_AMTP"] = serial.empty() ? model : serial;
-      auto pred = [](unsigned char c) { return isspace(c); };
-      amtp.erase(remove_if(amtp.begin(), amtp.end(), pred), amtp.end());
-    #endif
-    //TODO: Generate UUID
-
-    uint64_t st_size = 0, st_free = 0;
-    for(LIBMTP_devicestorage_t* st = dev->storage; st; st = st->next)
-     { st_size += st->MaxCapacity; st_free += st->FreeSpaceInBytes; }
-
-    if(st_size && st_free <= st_size)
-     {
-      r["SIZE"]    = human_readable_b(st_size, false);
-      r["FSAVAIL"] = human_readable_b(st_free, false);
-      r["FSUSED"]  = human_readable_b(st_size - st_free, false);
-      r["FSUSE%"]  = to_string((st_size - st_free) * 100 / st_size) + "%";
-     }
-    LIBMTP_Dump_Errorstack(dev);
-    LIBMTP_Clear_Errorstack(dev);
-    LIBMTP_Release_Device(dev);
+    mtp_cache_entry& e = res.emplace_back(mtp_cache_entry{rds[i], {}});
+    bool cached = false;
+    {
+      lock_guard data{mtp_cache.data};
+      for(auto& c : mtp_cache.devices)
+        if(c.same_device(rds[i])) { e.info = c.info; cached = true; break; }
+    }
+    if(!cached && !read_mtp_device(e.raw, e.info))
+     { /*log("Failed to open MTP Device #" + to_string(i + 1));*/ res.pop_back(); }
    }
   LIBMTP_FreeMemory(rds);
+  return res;
+}
+//-------------------------------------------------------------------------------------------------
+
+static void add_mtp_devices(device_map& out)
+{
+  unique_lock data{mtp_cache.data};
+  if(!mtp_cache.hotplug || !mtp_cache.detected)
+   {
+    const unsigned gen = mtp_cache.generation;
+    data.unlock();
+    vector<mtp_cache_entry> found = detect_mtp_devices();
+    data.lock();
+    mtp_cache.devices  = std::move(found);
+    mtp_cache.detected = (gen == mtp_cache.generation); //no USB device was added meanwhile
+   }
+  for(size_t i = 0; i < mtp_cache.devices.size(); ++i)
+   {
+    device_info& r = out.emplace_back(mtp_cache.devices[i].info);
+    if(r[NAME].empty()) r[NAME] = "MTP#" + to_string(i + 1);
+    r[MTP] = to_string(i + 1);
+   }
+}
+//-------------------------------------------------------------------------------------------------
+
+void mtp_cache_enable(bool hotplug)
+{
+  lock_guard data{mtp_cache.data};
+  mtp_cache.hotplug = hotplug;
+}
+//-------------------------------------------------------------------------------------------------
+
+///Forget removed USB device, or schedule detection for added one.
+static void mtp_cache_usb_event(const uevent& e)
+{
+  lock_guard data{mtp_cache.data};
+  if(e.action == "add") { ++mtp_cache.generation; mtp_cache.detected = false; return; }
+  erase_if(mtp_cache.devices, [&](const mtp_cache_entry& c)
+           { return c.raw.bus_location == e.busnum && c.raw.devnum == e.devnum; });
+  if(!e.busnum) mtp_cache.detected = false; //unknown device
+}
+//-------------------------------------------------------------------------------------------------
+
+bool mtp_cache_refresh_storage(const std::vector<std::string>& usb_paths)
+{
+  vector<LIBMTP_raw_device_t> raws;
+  {
+    lock_guard data{mtp_cache.data};
+    for(auto& c : mtp_cache.devices)
+      if(ranges::find(usb_paths, c.info.at(PATH)) != usb_paths.end()) raws.push_back(c.raw);
+  }
+  bool changed = false;
+  for(auto& raw : raws)
+   {
+    device_info info;
+    {
+      lock_guard lock{mtp_cache.libmtp};
+      if(!read_mtp_device(raw, info)) continue; //gone
+    }
+    lock_guard data{mtp_cache.data};
+    for(auto& c : mtp_cache.devices)
+      if(c.same_device(raw) && c.info != info) { c.info = std::move(info); changed = true; break; }
+   }
+  return changed;
 }
 //-------------------------------------------------------------------------------------------------
@@ -23,9 +23,12 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #ifndef DEVMAP_H
 #define DEVMAP_H
 //-------------------------------------------------------------------------------------------------
+#include <array>
 #include <vector>
 #include <map>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 
 //-------------------------------------------------------------------------------------------------
 struct mount_unit
@@ -35,9 +38,82 @@ struct mount_unit
   int what_sel = PATH;
 };
 
-using device_info = std::map<std::string, std::string>;
+/** @brief Device record (one row of the device list).
+ *  @details Column names are the same as in lsblk/findmnt, "_" marks mount-gui's own columns.
+ *  Common columns are stored in place and indexed by `column`, rare ones (e.g. "_AMTP",
+ *  "FSAVAIL") go to a small overflow map. Access by name is kept for compatibility.
+ */
+class device_info
+{
+public:
+  enum column : unsigned char
+  {
+    PATH, NAME, MOUNTPOINT, PARTUUID, UUID, LABEL, PARTLABEL, PKNAME, TYPE, SIZE, SERIAL,
+    MODEL, FSTYPE, OPTIONS, RM, HOTPLUG, HOST, IP, MTP /*_MTP*/, NETDEV /*_NETDEV*/, COLUMNS_N
+  };
+  static const std::array<std::string_view, COLUMNS_N> column_names;
+  ///Fixed column by name, COLUMNS_N if there is none.
+  static column column_id(std::string_view name) noexcept;
+
+  std::string&       operator[](column c) noexcept       { return cols[c]; }
+  const std::string& operator[](column c) const noexcept { return cols[c]; }
+  std::string&       at(column c) noexcept               { return cols[c]; }
+  const std::string& at(column c) const noexcept         { return cols[c]; }
+
+  ///Column by name, missing overflow column is created.
+  std::string&       operator[](std::string_view name);
+  ///Column by name, throws std::out_of_range if overflow column is missing.
+  std::string&       at(std::string_view name);
+  const std::string& at(std::string_view name) const;
+  ///Column by name or nullptr.
+  const std::string* find(std::string_view name) const noexcept;
+
+  ///Call f(name, value) for every column.
+  template<class F> void for_each(F&& f) const
+   {
+    for(unsigned c = 0; c < COLUMNS_N; ++c) f(column_names[c], cols[c]);
+    for(auto& [n, v] : extra) f(std::string_view{n}, v);
+   }
+
+  bool operator==(const device_info&) const = default;
+
+private:
+  std::array<std::string, COLUMNS_N> cols;
+  std::map<std::string, std::string, std::less<>> extra;
+};
+
 using device_map  = std::vector<device_info>;
-using mount_db    = std::vector<mount_unit>;
+
+/** @brief Systemd mount units, indexed by Where= and What=.
+ *  @details Indexes hold unit numbers: call reindex() after units were added or changed.
+ */
+class mount_db : public std::vector<mount_unit>
+{
+  std::unordered_map<std::string, size_t> where_idx, what_idx[mount_unit::INV_SEL];
+public:
+  void reindex();
+  ///First unit with given Where=
+  mount_unit* find_where(const std::string& where);
+  ///First unit with given What= selector (mount_unit::PATH, LABEL, ...) and value
+  mount_unit* find_what(int sel, const std::string& what);
+};
+
+/** @brief Index of device map rows by PATH.
+ *  @details Holds row numbers: rebuild() it after rows were inserted, erased or reordered,
+ *  or add() rows appended to the end.
+ */
+class device_index
+{
+  std::unordered_map<std::string, size_t> by_path;
+public:
+  device_index() = default;
+  explicit device_index(const device_map& dmap) { rebuild(dmap); }
+
+  void rebuild(const device_map& dmap);
+  ///Index row dmap[n] (the first row with the same PATH wins, as in find_device()).
+  void add(const device_map& dmap, size_t n) { by_path.try_emplace(dmap[n][device_info::PATH], n); }
+  device_info* find(device_map& dmap, const std::string& path) const;
+};
 
 ///Information about device being mounted and target directory.
 struct mount_info
@@ -53,11 +129,68 @@ std::string unescape_hex(std::string_view str);
  *  @details Pair delemiter is a space.
  *  Accounts for spaces around "=" and quotes around value.
  */
-bool extract_nameval_pair(const std::string& str, size_t &pos,
+bool extract_nameval_pair(std::string_view str, size_t &pos,
                           std::string &name, std::string &value);
 //-------------------------------------------------------------------------------------------------
 
-device_map system_scan_devices(const mount_db& system_db);
+///Result of a full system scan.
+struct system_snapshot
+{
+  mount_db   units;
+  device_map devices;
+};
+
+/** @brief Scan systemd units, block devices, MTP devices, mounts and preconfigured network shares.
+ *  @details Sources are scanned concurrently and merged in fixed order, timings go to the log.
+ *  @param method "sysfs" (default), "lsblk", or "compare" (scan both, log differences).
+ *  @param with_mtp detect MTP devices (slow if libmtp has to open them).
+ */
+system_snapshot system_scan(std::string_view method = "sysfs", bool with_mtp = true);
+
+///Save device list in `lsblk -P` format (to show it at next start, before the first scan).
+bool save_device_list(const device_map& dmap, const std::string& path);
+///Load device list saved by save_device_list(), empty if there is none.
+device_map load_device_list(const std::string& path);
+
+/** @brief Re-read mount table and apply it to the device map.
+ *  @details Only MOUNTPOINT and OPTIONS of existing rows are updated in place and their
+ *  addresses are added to `changed`. If mounted network shares or MTP devices appeared
+ *  or disappeared, the whole map is replaced and true is returned.
+ *  Nothing here blocks on mounted filesystems: SIZE of mounted shares is left empty.
+ */
+bool update_mounts(device_map& dmap, const mount_db& system_db,
+                   std::vector<device_info*>& changed);
+
+/** @brief Keep detected MTP devices between scans until a USB device is added.
+ *  @details Only safe if USB hotplug events reach apply_uevents(). Otherwise every scan runs
+ *  libmtp detection, though known devices (same USB bus, devnum and vendor:product) are still
+ *  not reopened.
+ */
+void mtp_cache_enable(bool hotplug);
+
+/** @brief Re-read name and free space of cached MTP devices (slow, opens each device).
+ *  @details Only devices listed by USB path (/dev/bus/usb/BBB/DDD, i.e. bus and devnum) are
+ *  opened, pass unmounted ones: mounted device belongs to its FUSE daemon.
+ *  Returns true if anything changed, apply it with scan_mtp_devices() and update_mtp_rows().
+ */
+bool mtp_cache_refresh_storage(const std::vector<std::string>& usb_paths);
+
+/** @brief Rows of cached MTP devices, newly attached ones are detected first.
+ *  @details Slow if libmtp has to open a device, call it on a worker thread.
+ */
+device_map scan_mtp_devices();
+
+///Replace unmounted MTP device rows with ones from scan_mtp_devices().
+void update_mtp_rows(device_map& dmap, device_map mtp);
+
+struct uevent;
+/** @brief Apply block device and USB hotplug events to the device map.
+ *  @details Only devices named in events are re-read from sysfs. Returns true if the map
+ *  was changed. USB device add/remove only invalidates MTP cache and sets `mtp_changed`:
+ *  MTP rows should be re-read with scan_mtp_devices() off the GUI thread.
+ */
+bool apply_uevents(device_map& dmap, const mount_db& system_db,
+                   const std::vector<uevent>& events, bool& mtp_changed);
 
 mount_db scan_systemd_units();
 bool     read_systemd_unit(const std::string& path, mount_unit& out);
@@ -73,7 +206,7 @@ mount_unit* find_mount_unit(mount_db& db, const device_info& dev);
 //-------------------------------------------------------------------------------------------------
 ///Find device by path
 inline device_info* find_device(device_map& devmap, const std::string& path)
-{ for(auto& d : devmap) { if(d.at("PATH") == path) return &d; } return nullptr; }
+{ for(auto& d : devmap) { if(d[device_info::PATH] == path) return &d; } return nullptr; }
 ///Find device in multiple maps
 template<class... Ts> inline device_info* find_device(Ts&&... devmaps, const std::string& path)
 { device_info* d; return ((d = find_device(devmaps, path)) || ...), d; }
@@ -0,0 +1,172 @@
+/* Copyright (c) 2015-2023 Kovshov K.A.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/** @file dns_cache.cpp
+ *  @author Kovshov K.A. (kirillnow@gmail.com)
+ *  @brief Cached host name lookups on a small worker pool.
+ */
+//-------------------------------------------------------------------------------------------------
+
+#include "dns_cache.h"
+#include "wsd_probe.h"
+#include "common/execute.h"
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <unordered_map>
+
+using namespace std;
+//-------------------------------------------------------------------------------------------------
+namespace {
+
+using dns_clock = chrono::steady_clock;
+constexpr auto positive_ttl = 5min, negative_ttl = 1min; //getnameinfo() does not tell TTL
+constexpr unsigned pool_size = 4;
+
+struct dns_entry
+{
+  string value;
+  bool done = false;
+  dns_clock::time_point expires;
+};
+
+/** @brief Lookup results by "R<ip>" (reverse) or "F<host>" (forward).
+ *  @details Workers are detached and the cache is never destroyed, so a lookup stuck in the
+ *  system resolver does not delay program exit. Expired entries are dropped when a new
+ *  lookup starts, at most once per negative_ttl.
+ */
+class dns_cache
+{
+  mutex lock;
+  condition_variable_any cv;
+  unordered_map<string, dns_entry> entries;
+  deque<string> queue;
+  unsigned workers = 0;
+  dns_clock::time_point next_prune;
+  mutex notify_lock; //held while notify() runs
+  function<void()> notify;
+
+  static string lookup(const string& key)
+  {
+    const string name = key.substr(1);
+    if(key[0] == 'F') return get_host_addr(name);
+    string host;
+    get_host_name(name, name.find(':') != string::npos, host);
+    return host;
+  }
+
+  void store(const string& key, string value)
+  {
+    lock_guard l{lock};
+    dns_entry& e = entries[key];
+    e.expires = dns_clock::now() + (value.empty() ? negative_ttl : positive_ttl);
+    e.value = std::move(value); e.done = true;
+    cv.notify_all();
+  }
+
+  void worker()
+  {
+    for(;;)
+     {
+      string key;
+      {
+        unique_lock l{lock};
+        cv.wait(l, [this] { return queue.size(); });
+        key = std::move(queue.front()); queue.pop_front();
+      }
+      store(key, lookup(key));
+      lock_guard l{notify_lock};
+      if(notify) notify();
+     }
+  }
+
+  ///Entry state under lock: 1 - cached, 0 - in flight, -1 - caller should look it up.
+  int find(const string& key, string& out)
+  {
+    auto [it, added] = entries.try_emplace(key);
+    dns_entry& e = it->second;
+    if(e.done && e.expires > dns_clock::now()) { out = e.value; return 1; }
+    if(!added && !e.done) return 0;
+    e.done = false;
+    return -1;
+  }
+
+  ///Queue lookup of an entry marked by find(), under lock.
+  void start(const string& key)
+  {
+    const auto now = dns_clock::now();
+    if(now >= next_prune)
+     {
+      erase_if(entries, [&](auto& x) { return x.second.done && x.second.expires <= now; });
+      next_prune = now + negative_ttl;
+     }
+    queue.push_back(key);
+    if(workers < pool_size) { ++workers; thread([this] { worker(); }).detach(); }
+    cv.notify_all();
+  }
+
+public:
+  void set_notify(function<void()> fn) { lock_guard l{notify_lock}; notify = std::move(fn); }
+
+  bool get_async(const string& key, string& out)
+  {
+    lock_guard l{lock};
+    int r = find(key, out);
+    if(r < 0) start(key);
+    return r > 0;
+  }
+
+  ///Wait for the answer within exec_limits, empty string on timeout or stop.
+  string get(const string& key)
+  {
+    const stop_token& stop = exec_limits.stop;
+    const int ms = exec_limits.timeout_ms;
+    const auto deadline = dns_clock::now() + chrono::milliseconds(ms);
+    auto settled = [&]
+     { auto it = entries.find(key); return it == entries.end() || it->second.done; };
+    string out;
+    unique_lock l{lock};
+    for(int r; (r = find(key, out)) <= 0; )
+     {
+      if(r < 0) start(key);
+      if(stop.stop_requested() || (ms && dns_clock::now() >= deadline)) return {};
+      if(ms) cv.wait_until(l, stop, deadline, settled);
+      else   cv.wait(l, stop, settled);
+     }
+    return out;
+  }
+};
+
+dns_cache& cache() { static dns_cache& c = *new dns_cache; return c; }
+
+} //namespace
+//-------------------------------------------------------------------------------------------------
+
+bool cached_host_name(const std::string& ip, std::string& out)
+{ return cache().get_async('R' + ip, out); }
+
+bool cached_host_addr(const std::string& host, std::string& out)
+{ return cache().get_async('F' + host, out); }
+
+std::string resolve_host_name(const std::string& ip) { return cache().get('R' + ip); }
+
+std::string resolve_host_addr(const std::string& host) { return cache().get('F' + host); }
+
+void set_dns_cache_notify(std::function<void()> fn) { cache().set_notify(std::move(fn)); }
+//-------------------------------------------------------------------------------------------------
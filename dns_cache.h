@@ -0,0 +1,54 @@
+/* Copyright (c) 2015-2023 Kovshov K.A.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/** @file dns_cache.h
+ *  @author Kovshov K.A. (kirillnow@gmail.com)
+ *  @brief Cached host name lookups on a small worker pool.
+ */
+
+#ifndef DNS_CACHE_H
+#define DNS_CACHE_H
+//-------------------------------------------------------------------------------------------------
+#include <string>
+#include <functional>
+
+/** @brief Cached reverse lookup that never blocks.
+ *  @details Returns false if the answer is not known yet: a lookup is started in background
+ *  (once for all concurrent requests) and the notify function is called when it is done.
+ *  Empty `out` with true result means the address has no name.
+ */
+bool cached_host_name(const std::string& ip, std::string& out);
+
+///Cached forward lookup that never blocks, see cached_host_name().
+bool cached_host_addr(const std::string& host, std::string& out);
+
+/** @brief Cached reverse lookup, waits for the answer (for worker threads).
+ *  @details The wait is bounded by exec_limits (timeout_ms and stop): if it runs out, the
+ *  result is empty as for an address without a name, and the caller shows the bare address.
+ *  The lookup itself goes on in background and its answer is cached.
+ */
+std::string resolve_host_name(const std::string& ip);
+
+///Cached forward lookup, waits for the answer within exec_limits (empty if it runs out).
+std::string resolve_host_addr(const std::string& host);
+
+/** @brief Set function called on a worker thread after a background lookup has finished.
+ *  @details Once this returns, the previous function is not running and won't be called.
+ */
+void set_dns_cache_notify(std::function<void()> fn);
+//-------------------------------------------------------------------------------------------------
+#endif // DNS_CACHE_H
@@ -38,7 +38,7 @@ using namespace std;
 //-------------------------------------------------------------------------------------------------
 
 namespace option {
-enum  optionIndex { UNKNOWN, HELP, XDG_CD };
+enum  optionIndex { UNKNOWN, HELP, XDG_CD, STARTUP_TRACE };
 
 static option::ArgStatus Required(const option::Option& opt, bool msg)
 {
@@ -54,6 +54,8 @@ const option::Descriptor usage[] =
  { HELP, 0, "", "help", Arg::None, "  --help  \tPrint usage and exit." },
  { XDG_CD, 0, "", "xdg-cd", Required, "  --xdg-cd \t"
    "Value of XDG_CURRENT_DESKTOP when launching with pkexec." },
+ { STARTUP_TRACE, 0, "", "startup-trace", Arg::None, "  --startup-trace \t"
+   "Print timings of startup stages to stderr." },
  {0,0,0,0,0,0}
 };
 } //end namespace option
@@ -106,6 +108,8 @@ int main(int argc, char *argv[])
   if (options[option::HELP])
     { option::printUsage(std::cout, option::usage); return 0; }
 
+  startup_trace = options[option::STARTUP_TRACE].count() > 0;
+
 //  for (int i = 0; i < parse.nonOptionsCount(); ++i)
 //    { program_options.file_list.emplace_back(parse.nonOption(i)); }
 
@@ -117,9 +121,11 @@ int main(int argc, char *argv[])
   char _arg0[] = "mount-gui"; //Making running this as root slightly less risky
   char* _args[] = {_arg0, nullptr};
   QApplication app(argc = 1, _args);
+  trace_startup("QApplication");
 
   MainWindow main_window;
   main_window.show();
+  trace_startup("main window created");
 
   return app.exec();
 }
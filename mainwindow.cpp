@@ -26,18 +26,30 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "ui_mainwindow.h"
 #include "systemd_dialog.h"
 #include "common/glob.h"
+#include "common/execute.h"
+#include "dns_cache.h"
 #include <QFont>
 #include <QTimer>
+#include <QDateTime>
+#include <QThread>
+#include <QTreeWidgetItemIterator>
 #include <QDesktopServices>
 #include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
 //#ifdef Q_WS_X11
 //  #include "common/x11_hacks.h"
 //#endif
 
 using namespace std;
+using enum device_info::column;
 //-------------------------------------------------------------------------------------------------
-//required by execute()
-void refresh_ui() { qApp->sendPostedEvents(); qApp->processEvents(); }
+//required by execute(); worker threads just wait
+void refresh_ui()
+{
+  if(QThread::currentThread() != qApp->thread()) return;
+  qApp->sendPostedEvents(); qApp->processEvents();
+}
 //-------------------------------------------------------------------------------------------------
 
 MainWindow::MainWindow(QWidget *parent)
@@ -49,16 +61,25 @@ MainWindow::MainWindow(QWidget *parent)
   ui->UnmountButton->setDefaultAction(ui->actionUnmount);
   ui->StatusBar->addWidget(ui->StatusBarLabel, 1); //uic does not do this
 
-  //call OnActionRefresh() on start
-  connect(this, SIGNAL(onShow()), this, SLOT(OnActionRefresh()),
+  //staged startup once the window is painted, then OnActionRefresh() on each show
+  connect(this, SIGNAL(onShow()), this, SLOT(OnStartup()),
           Qt::ConnectionType(Qt::QueuedConnection | Qt::UniqueConnection));
   connect(&fsw, &QFileSystemWatcher::directoryChanged, this, &MainWindow::FSWatch,
           Qt::ConnectionType(Qt::QueuedConnection));
   connect(&fsw, &QFileSystemWatcher::fileChanged, this, &MainWindow::FSWatch,
           Qt::ConnectionType(Qt::QueuedConnection));
 
-  log_fn = [this](string s, const char* c) { Log(std::move(s), c); };
-
+  log_fn = [this](string s, const char* c)
+   {
+    if(QThread::currentThread() == thread()) { Log(std::move(s), c); return; }
+    QMetaObject::invokeMethod(this, [this, s = std::move(s), c]() mutable
+                              { Log(std::move(s), c); }, Qt::QueuedConnection);
+   };
+  //host names and addresses of network shares are filled in as lookups complete
+  set_dns_cache_notify([this]
+   { QMetaObject::invokeMethod(this, [this] { ScheduleBlkListUpdate(); }, Qt::QueuedConnection); });
+
+  trace_startup("main window setup");
   usr_info.fetch_current();
   settings.load_settings(usr_info.user_home + CONFIG_FILE_PATH, usr_info);
   if(!usr_info.uid) settings.sudo_cmd.clear();
@@ -67,16 +88,40 @@ MainWindow::MainWindow(QWidget *parent)
   if(settings.hostname.empty() || settings.hostname == "auto")
     settings.hostname = gethostname();
 
-  net_if_list = list_active_interfaces();
-
-  if(auto list = glob({"/dev/block", "/dev/bus/usb", "/dev/bus/usb/*"}))
+  if(int fd = uevent_open(); fd >= 0)
+   {
+    uevent_watch = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+    connect(uevent_watch, &QSocketNotifier::activated, this, &MainWindow::OnUevent);
+    mtp_cache_enable(true);
+   }
+  else if(auto list = glob({"/dev/block", "/dev/bus/usb", "/dev/bus/usb/*"}))
     for(char* p : list)
       if(!fsw.addPath(qstr(p))) log("Failed to add '"s + p + "' to filesystem watch.");
+
+  //kernel reports mount table changes as POLLPRI|POLLERR on any open mountinfo file
+  if(int fd = open("/proc/self/mountinfo", O_RDONLY|O_CLOEXEC); fd >= 0)
+   {
+    mnt_watch = new QSocketNotifier(fd, QSocketNotifier::Exception, this);
+    connect(mnt_watch, &QSocketNotifier::activated, this, &MainWindow::OnMountTableChanged);
+   }
+  else log("Failed to open /proc/self/mountinfo: " + s_errno());
+
+  connect(&mtp_storage_timer, &QTimer::timeout, this, &MainWindow::OnMtpStorageTimer);
+  mtp_storage_timer.start(mtp_storage_interval_ms);
+  trace_startup("settings and watchers");
 }
 //-------------------------------------------------------------------------------------------------
 
 MainWindow::~MainWindow()
 {
+  //workers use ui and device maps: stop and join them before anything is torn down
+  for(bg_job* bj : {&refresh_job, &netscan_job, &mtp_job, &size_job})
+    bj->worker.request_stop();
+  for(bg_job* bj : {&refresh_job, &netscan_job, &mtp_job, &size_job})
+    if(bj->worker.joinable()) bj->worker.join();
+  set_dns_cache_notify({});
+  if(mnt_watch) ::close(mnt_watch->socket());
+  if(uevent_watch) ::close(uevent_watch->socket());
   delete ui;
 }
 //-------------------------------------------------------------------------------------------------
@@ -97,6 +142,17 @@ void MainWindow::closeEvent(QCloseEvent *event)
 {
   if(!fsw.files().contains(qstr(settings.config_file))) //external editor isn't still open
     settings.save_settings(usr_info);
+  const bool save_netscan = stoi(settings.netscan_cache_days) > 0;
+  if(main_dev_map.size() || save_netscan)
+   {
+    privileges_guard priv;
+    string dir;
+    if(priv.drop_if_feasible(usr_info) && !(dir = cache_dir(usr_info)).empty())
+     {
+      if(main_dev_map.size()) save_device_list(main_dev_map, dir + "/devices");
+      if(save_netscan) save_netscan_cache(net_dev_map, dir + "/netscan.list");
+     }
+   }
   event->accept();
 }
 //-------------------------------------------------------------------------------------------------
@@ -128,15 +184,15 @@ void MainWindow::UpdateStatusLabel(const std::string& text, const char* color)
 
 void MainWindow::PopulateFormFields(device_info& dev)
 {
-  bool   mounted    = !dev["MOUNTPOINT"].empty();
-  string mountpoint = mounted ? dev["MOUNTPOINT"] : settings.mountpoint;
-  string options    = dev["OPTIONS"];
-  string fs_type    = dev["FSTYPE"];
-  string path       = dev["PATH"];
+  bool   mounted    = !dev[MOUNTPOINT].empty();
+  string mountpoint = mounted ? dev[MOUNTPOINT] : settings.mountpoint;
+  string options    = dev[OPTIONS];
+  string fs_type    = dev[FSTYPE];
+  string path       = dev[PATH];
 
   if(!mounted)
    {
-    if(!dev["_MTP"].empty())
+    if(!dev[MTP].empty())
       fs_type = "fuse." + settings.default_mtpfs;
 
     //find a more conventional name for the filesystem
@@ -144,7 +200,7 @@ void MainWindow::PopulateFormFields(device_info& dev)
     if(alias_iter != settings.aliases.end())
       fs_type = alias_iter->second;
 
-    if(auto p = settings.find_suitable(fs_type, dev["LABEL"], dev["UUID"]))
+    if(auto p = settings.find_suitable(fs_type, dev[LABEL], dev[UUID]))
      {
       if(!p->mountpoint.empty()) mountpoint = p->mountpoint;
       options = p->options;
@@ -155,7 +211,7 @@ void MainWindow::PopulateFormFields(device_info& dev)
      {
       mountpoint = mu->where;
       options    = mu->options;
-      fs_type    = mu->fstype.empty() ? dev["FSTYPE"] : mu->fstype;
+      fs_type    = mu->fstype.empty() ? dev[FSTYPE] : mu->fstype;
      }
    }
 
@@ -178,7 +234,7 @@ void MainWindow::PopulateBlkListWidget()
   string curr_dev = stdstr(ui->MntDeviceEdit->text());
 
   QFontMetrics metric = ui->BlkListWidget->fontMetrics();
-  int col_mw = width()/3, sep2mw = width()/5;
+  int col_mw = width()/3;
 
   struct insit { QTreeWidgetItem* wi; string name, sh_type; };
   vector<insit> inserted;
@@ -186,26 +242,24 @@ void MainWindow::PopulateBlkListWidget()
   auto contains = [&](auto&& s, auto&& t)
    { for(auto& x : inserted) if(x.name == s && netdev_type_eq(x.sh_type, t)) return true;
      return false;                                                                         };
-  auto comm = [](auto&& n, auto&&... s) { return n + ((s.empty() ? ""s : "  " + s) + ...); };
 
   ui->BlkListWidget->clear();
   update_netdevs_values(main_dev_map, net_dev_map, net_if_list, settings.hostname);
+  main_dev_index.rebuild(main_dev_map);
+  FillMountSizes();
 
   for(device_map* devmap : {&main_dev_map, &net_dev_map}) for(auto& i: *devmap)
   {
-    string &name = i["NAME"], &pkname = i["PKNAME"], fstype = i["FSTYPE"];
+    string &name = i[NAME], &pkname = i[PKNAME], fstype = i[FSTYPE];
 
     if(starts_with(fstype, "fuse.") && fstype.size() > 5)
       fstype = get<1>(split2v(fstype, '.'));
 
-    const bool netdev = i["_NETDEV"].size();
+    const bool netdev = i[NETDEV].size();
     if(netdev && contains(pkname + toupper(name), fstype)) continue;
 
     QTreeWidgetItem *parent = nullptr, *item = new QTreeWidgetItem;
     set_data(item, &i);
-    item->setText(0, qstr(name));            item->setText(1, qstr(i["SIZE"]));
-    item->setText(2, qstr(fstype));          item->setText(3, qstr(i["LABEL"]));
-    item->setText(4, qstr(i["MOUNTPOINT"])); item->setText(5, qstr(i["UUID"]));
 
     if(pkname.size()) for(auto& x : inserted) { if(x.name == pkname) parent = x.wi; }
     if(netdev && !parent)
@@ -225,16 +279,9 @@ void MainWindow::PopulateBlkListWidget()
 
     if(parent) parent->addChild(item);
     else ui->BlkListWidget->addTopLevelItem(item);
+    UpdateBlkListItem(item, i);
 
-    if(i["MOUNTPOINT"].empty() && (fstype.empty() || i["SIZE"].empty()))
-     {
-      string fst = fstype.empty() ? "" : "[" + toupper(fstype) + "]";
-      auto* sep = (metric.horizontalAdvance(qstr(name)) > sep2mw) ? "  " : "\t ";
-      item->setText(0, qstr(comm(name + sep, fst, i["SIZE"], i["MODEL"], i["SERIAL"])));
-      item->setFirstColumnSpanned(true);
-     }
-
-    if(i["PATH"] == curr_dev) select_item = item;
+    if(i[PATH] == curr_dev) select_item = item;
 
     if(parent) continue;
     if(starts_with(name, "sr") || starts_with(name, "scd"))
@@ -243,9 +290,9 @@ void MainWindow::PopulateBlkListWidget()
      { item->setIcon(0, QIcon(":/icons/nvme.png")); }
     else if(starts_with(name, "loop"))
      { item->setIcon(0, QIcon(":/icons/loop.png")); }
-    else if(i["RM"] == "1")
+    else if(i[RM] == "1")
      { item->setIcon(0, QIcon(":/icons/usb-stick.png")); }
-    else if(i["RM"] == "USB")
+    else if(i[RM] == "USB")
      { item->setIcon(0, QIcon(":/icons/usb-hdd.png")); }
     else if(name == "fd0" || name == "fd1")
      { item->setIcon(0, QIcon(":/icons/fdd.png")); }
@@ -266,6 +313,40 @@ void MainWindow::PopulateBlkListWidget()
 }
 //-------------------------------------------------------------------------------------------------
 
+void MainWindow::UpdateBlkListItem(QTreeWidgetItem* item, device_info& i)
+{
+  QFontMetrics metric = ui->BlkListWidget->fontMetrics();
+  auto comm = [](auto&& n, auto&&... s) { return n + ((s.empty() ? ""s : "  " + s) + ...); };
+  string &name = i[NAME], fstype = i[FSTYPE];
+
+  if(starts_with(fstype, "fuse.") && fstype.size() > 5)
+    fstype = get<1>(split2v(fstype, '.'));
+
+  item->setText(0, qstr(name));        item->setText(1, qstr(i[SIZE]));
+  item->setText(2, qstr(fstype));      item->setText(3, qstr(i[LABEL]));
+  item->setText(4, qstr(i[MOUNTPOINT])); item->setText(5, qstr(i[UUID]));
+
+  const bool span = i[MOUNTPOINT].empty() && (fstype.empty() || i[SIZE].empty());
+  if(span)
+   {
+    string fst = fstype.empty() ? "" : "[" + toupper(fstype) + "]";
+    auto* sep = (metric.horizontalAdvance(qstr(name)) > width()/5) ? "  " : "\t ";
+    item->setText(0, qstr(comm(name + sep, fst, i[SIZE], i[MODEL], i[SERIAL])));
+   }
+  item->setFirstColumnSpanned(span);
+
+  //cached network share that was not seen by the last scan
+  const string* stale = i.find("STALE");
+  const string* seen  = i.find("SEEN");
+  const bool grey = stale && stale->size();
+  for(int c = 0; c < item->columnCount(); ++c)
+    item->setData(c, Qt::ForegroundRole, grey ? QVariant(ui->BlkListWidget->palette().brush(
+                                          QPalette::Disabled, QPalette::Text)) : QVariant());
+  item->setToolTip(0, grey && seen ? qstr("Last seen ") + QDateTime::fromSecsSinceEpoch(
+                                       qstr(*seen).toLongLong()).toString() : QString());
+}
+//-------------------------------------------------------------------------------------------------
+
 bool MainWindow::GatherMountInfo(mount_info& out)
 {
   out.path    = trim(stdstr(ui->MntDeviceEdit->text()));
@@ -279,7 +360,7 @@ bool MainWindow::GatherMountInfo(mount_info& out)
   if(sanitize_name(out.path).empty())
    { log("Device paths without alphanumerical characters are not supported!", ""); return false; }
 
-  out.dev = find_device(main_dev_map, out.path);
+  out.dev = main_dev_index.find(main_dev_map, out.path);
   return true;
 }
 //-------------------------------------------------------------------------------------------------
@@ -293,12 +374,12 @@ void MainWindow::OnBlkListSelection(QTreeWidgetItem* curr)
 
 void MainWindow::OnMntDeviceChanged(const QString &text)
 {
-  device_info* dev = find_device(main_dev_map, stdstr(text));
-  ui->actionMount->setEnabled(text.size() && (!dev || dev->at("MOUNTPOINT").empty()));
-  ui->actionUnmount->setEnabled(dev && !dev->at("MOUNTPOINT").empty());
-  ui->actionSave_by_FS->setEnabled(dev && !dev->at("FSTYPE").empty());
-  ui->actionSave_by_Label->setEnabled(dev && !dev->at("LABEL").empty());
-  ui->actionSave_by_UUID->setEnabled(dev && !dev->at("UUID").empty());
+  device_info* dev = main_dev_index.find(main_dev_map, stdstr(text));
+  ui->actionMount->setEnabled(text.size() && (!dev || dev->at(MOUNTPOINT).empty()));
+  ui->actionUnmount->setEnabled(dev && !dev->at(MOUNTPOINT).empty());
+  ui->actionSave_by_FS->setEnabled(dev && !dev->at(FSTYPE).empty());
+  ui->actionSave_by_Label->setEnabled(dev && !dev->at(LABEL).empty());
+  ui->actionSave_by_UUID->setEnabled(dev && !dev->at(UUID).empty());
   ui->actionMakeFstabEntry->setEnabled(!ui->MountpointEdit->text().isEmpty());
   ui->actionMakeSystemdUnit->setEnabled(!ui->MountpointEdit->text().isEmpty());
 }
@@ -352,59 +433,345 @@ void MainWindow::FSWatch(const QString &path)
 }
 //-------------------------------------------------------------------------------------------------
 
-void MainWindow::OnActionRefresh()
+void MainWindow::OnUevent()
 {
-  IF_REENTRY_RETURN();
-//  QApplication::setOverrideCursor(Qt::WaitCursor);
-  setCursor(Qt::WaitCursor);
-  try { system_db = scan_systemd_units(); }
-  catch(...) { log("Error: exception in scan_systemd_units()."); }
-  try { main_dev_map = system_scan_devices(system_db); }
-  catch(...) { log("Error: exception in system_scan_devices()."); }
+  const bool idle = pending_uevents.empty();
+  if(!uevent_receive(uevent_watch->socket(), pending_uevents))
+   { //events were lost, nothing to do but full refresh
+    pending_uevents.clear();
+    QTimer::singleShot(0, this, &MainWindow::OnActionRefresh);
+    return;
+   }
+  erase_if(pending_uevents, [](const uevent& e)
+           { return e.subsystem != "block" && (e.subsystem != "usb" || e.devtype != "usb_device"); });
+  //hotplug comes in bursts (disk, then its partitions), apply them together
+  if(idle && pending_uevents.size())
+    QTimer::singleShot(20, this, &MainWindow::ApplyUevents);
+}
+//-------------------------------------------------------------------------------------------------
+
+void MainWindow::ApplyUevents()
+{
+  vector<uevent> events; events.swap(pending_uevents);
+  if(refresh_job.running) { refresh_job.pending = true; return; } //scan may predate events
+  bool changed = false, mtp_changed = false;
+  try { changed = apply_uevents(main_dev_map, system_db, events, mtp_changed); }
+  catch(...) { log("Error: exception in apply_uevents()."); return; }
+  if(mtp_changed) ScanMtpDevices();
+  if(!changed) return;
   try { PopulateBlkListWidget(); }
   catch(...) { log("Error: exception in PopulateBlkListWidget()."); }
-//  QApplication::restoreOverrideCursor();
-  unsetCursor();
+  OnMntDeviceChanged(ui->MntDeviceEdit->text());
+}
+//-------------------------------------------------------------------------------------------------
+
+void MainWindow::ScanMtpDevices()
+{
+  if(mtp_job.running) { mtp_job.pending = true; return; }
+  RunInBackground(mtp_job, "scan_mtp_devices",
+                  [] { return make_shared<const device_map>(scan_mtp_devices()); },
+                  [this](shared_ptr<const device_map> mtp) { AdoptMtpDevices(mtp.get()); });
+}
+//-------------------------------------------------------------------------------------------------
+
+void MainWindow::AdoptMtpDevices(const device_map* mtp)
+{
+  if(mtp && !refresh_job.running) //otherwise refresh replaces the whole map
+   {
+    update_mtp_rows(main_dev_map, *mtp);
+    try { PopulateBlkListWidget(); }
+    catch(...) { log("Error: exception in PopulateBlkListWidget()."); }
+    OnMntDeviceChanged(ui->MntDeviceEdit->text());
+   }
+  if(exchange(mtp_job.pending, false)) ScanMtpDevices(); //USB device was added meanwhile
+}
+//-------------------------------------------------------------------------------------------------
+
+void MainWindow::OnMtpStorageTimer()
+{
+  vector<string> unmounted;
+  for(auto& d : main_dev_map) if(d[MTP].size() && d[MTP] != "*") unmounted.push_back(d[PATH]);
+  if(mtp_job.running || unmounted.empty()) return;
+  RunInBackground(mtp_job, "mtp_cache_refresh_storage",
+                  [unmounted] { return mtp_cache_refresh_storage(unmounted); },
+                  [this](bool changed)
+   {
+    //rows are read from updated cache on the worker too
+    if(exchange(mtp_job.pending, false) || changed) ScanMtpDevices();
+   });
+}
+//-------------------------------------------------------------------------------------------------
+
+void MainWindow::OnMountTableChanged()
+{
+  if(refresh_job.running || main_dev_map.empty()) return; //refresh will apply mount table
+  vector<string> mtp_mounts; //mounted MTP devices have no row of their own
+  for(auto& d : main_dev_map) if(d[MTP] == "*") mtp_mounts.push_back(d[PATH]);
+  vector<device_info*> changed;
+  bool rebuilt = false;
+  try { rebuilt = update_mounts(main_dev_map, system_db, changed); }
+  catch(...) { log("Error: exception in update_mounts()."); return; }
+
+  if(rebuilt)
+   {
+    //unmounted (e.g. by fusermount) MTP device gets its row back from the MTP cache
+    if(ranges::any_of(mtp_mounts, [this](const string& path)
+        { device_info* d = find_device(main_dev_map, path); return !d || (*d)[MTP] != "*"; }))
+      ScanMtpDevices();
+    try { PopulateBlkListWidget(); }
+    catch(...) { log("Error: exception in PopulateBlkListWidget()."); }
+   }
+  else if(changed.size())
+   {
+    FillMountSizes();
+    for(QTreeWidgetItemIterator it(ui->BlkListWidget); *it; ++it)
+      if(device_info* d = get_data(*it); d && ranges::find(changed, d) != changed.end())
+        UpdateBlkListItem(*it, *d);
+   }
+  else return;
+  OnMntDeviceChanged(ui->MntDeviceEdit->text());
+}
+//-------------------------------------------------------------------------------------------------
+
+void MainWindow::OnStartup()
+{
+  if(exchange(started, true)) { OnActionRefresh(); return; }
+  trace_startup("window shown");
+
+  //last known devices, so the list is not empty while scanning
+  main_dev_map = load_device_list(usr_info.user_home + CACHE_DIR_PATH "/devices");
+  net_dev_map  = load_netscan_cache(usr_info.user_home + CACHE_DIR_PATH "/netscan.list",
+                                    stoi(settings.netscan_cache_days));
+  if(main_dev_map.size() || net_dev_map.size())
+   {
+    try { PopulateBlkListWidget(); }
+    catch(...) { log("Error: exception in PopulateBlkListWidget()."); }
+    trace_startup("cached device list");
+   }
+
+  //fast sources first, MTP devices (and libmtp initialization) later
+  auto job = [method = settings.device_scan]
+   { return make_shared<const system_snapshot>(system_scan(method, false)); };
+  RunInBackground(refresh_job, "system_scan", std::move(job),
+                  [this](shared_ptr<const system_snapshot> snap)
+   {
+    AdoptSnapshot(snap.get());
+    trace_startup("device scan without MTP");
+    net_if_list = list_active_interfaces();
+    trace_startup("network interfaces");
+    refresh_job.pending = false;
+    OnActionRefresh();
+    CheckNetscanCache();
+   });
+}
+//-------------------------------------------------------------------------------------------------
+
+void MainWindow::AdoptSnapshot(const system_snapshot* snap)
+{
+  if(!snap) return;
+  system_db    = snap->units;
+  main_dev_map = snap->devices;
+  //mount table could change while scanning
+  vector<device_info*> changed;
+  try { update_mounts(main_dev_map, system_db, changed); }
+  catch(...) { log("Error: exception in update_mounts()."); }
+  try { PopulateBlkListWidget(); }
+  catch(...) { log("Error: exception in PopulateBlkListWidget()."); }
+}
+//-------------------------------------------------------------------------------------------------
+
+template<class Job, class Done>
+void MainWindow::RunInBackground(bg_job& bj, const char* name, Job job, Done done)
+{
+  bj.running = true;
+  if(bj.busy_cursor) { setCursor(Qt::BusyCursor); ui->actionStop->setEnabled(true); }
+  bj.worker = jthread([this, &bj, name, job = std::move(job), done = std::move(done)]
+                      (stop_token stop) mutable
+   {
+    exec_limits.stop = std::move(stop); //OnActionStop() cancels running commands
+    decltype(job()) res{};
+    try { res = job(); }
+    catch(...) { log("Error: exception in "s + name + "()."); }
+    QMetaObject::invokeMethod(this, [this, &bj, done = std::move(done), res = std::move(res)]() mutable
+     {
+      bj.running = false;
+      if(!refresh_job.running && !netscan_job.running)
+       {
+        ui->actionStop->setEnabled(false);
+        if(!mount_running) unsetCursor();
+       }
+      done(std::move(res));
+     }, Qt::QueuedConnection);
+   });
+}
+//-------------------------------------------------------------------------------------------------
+
+void MainWindow::FillMountSizes()
+{
+  auto needs_size = [](device_info& d)
+   { return d[MOUNTPOINT].size() && (d[NETDEV].size() || d[MTP] == "*"); };
+  //forget unmounted filesystems
+  erase_if(mount_size_cache, [&](auto& x)
+   {
+    return ranges::none_of(main_dev_map, [&](device_info& d)
+      { return needs_size(d) && d[PATH] == x.first.first && d[MOUNTPOINT] == x.first.second; });
+   });
+
+  vector<pair<string, string>> req;
+  for(auto& d : main_dev_map) if(needs_size(d))
+   {
+    auto it = mount_size_cache.find({d[PATH], d[MOUNTPOINT]});
+    if(it != mount_size_cache.end()) d[SIZE] = it->second;
+    else if(size_job.running) size_job.pending = true;
+    else req.push_back(mount_size_cache.try_emplace({d[PATH], d[MOUNTPOINT]}).first->first);
+   }
+  if(req.empty()) return;
+
+  vector<string> targets;
+  for(auto& r : req) targets.push_back(r.second);
+  auto job = [targets, timeout = stoi(settings.netscan_timeout) * 1000]
+   { return mount_sizes(targets, timeout, exec_limits.stop); };
+  RunInBackground(size_job, "mount_sizes", std::move(job), [this, req](vector<string> sizes)
+   {
+    vector<device_info*> changed;
+    for(size_t i = 0; i < sizes.size(); ++i)
+     {
+      if(auto it = mount_size_cache.find(req[i]); it != mount_size_cache.end())
+        it->second = sizes[i];
+      for(auto& d : main_dev_map)
+        if(d[PATH] == req[i].first && d[MOUNTPOINT] == req[i].second && d[SIZE] != sizes[i])
+         { d[SIZE] = sizes[i]; changed.push_back(&d); }
+     }
+    for(QTreeWidgetItemIterator it(ui->BlkListWidget); *it; ++it)
+      if(device_info* d = get_data(*it); d && ranges::find(changed, d) != changed.end())
+        UpdateBlkListItem(*it, *d);
+    if(exchange(size_job.pending, false)) FillMountSizes();
+   });
+}
+//-------------------------------------------------------------------------------------------------
+
+void MainWindow::OnActionRefresh()
+{
+  if(refresh_job.running) { refresh_job.pending = true; return; }
+  auto job = [method = settings.device_scan]
+   { return make_shared<const system_snapshot>(system_scan(method)); };
+  RunInBackground(refresh_job, "system_scan", std::move(job),
+                  [this](shared_ptr<const system_snapshot> snap)
+   {
+    AdoptSnapshot(snap.get());
+    if(startup_trace) { trace_startup("full device scan"); startup_trace = false; }
+    if(exchange(refresh_job.pending, false)) OnActionRefresh(); //snapshot predates hotplug
+   });
 }
 //-------------------------------------------------------------------------------------------------
 
 void MainWindow::OnActionMount()
 {
-  IF_REENTRY_RETURN();
+  if(mount_running) return;
   mount_info info;
   if(!GatherMountInfo(info)) return;
   setCursor(Qt::WaitCursor);
-  bool r = false;
-  try { r = mnt_helper.mount(info); }
+  try { mount_running = mnt_helper.mount(info, [this](bool ok) { MountFinished(ok); }); }
   catch(...) { log("Error: exception in mount()."); }
-  unsetCursor();
-  if(r) OnActionRefresh();
+  if(!mount_running) unsetCursor();
 }
 //-------------------------------------------------------------------------------------------------
 
 void MainWindow::OnActionUnmount()
 {
-  IF_REENTRY_RETURN();
+  if(mount_running) return;
   mount_info info;
   if(!GatherMountInfo(info)) return;
   setCursor(Qt::WaitCursor);
-  bool r = false;
-  try { r = mnt_helper.unmount(info); }
+  try { mount_running = mnt_helper.unmount(info, [this](bool ok) { MountFinished(ok); }); }
   catch(...) { log("Error: exception in unmount()."); }
-  unsetCursor();
-  if(r) OnActionRefresh();
+  if(!mount_running) unsetCursor();
+}
+//-------------------------------------------------------------------------------------------------
+
+void MainWindow::MountFinished(bool ok)
+{
+  mount_running = false;
+  if(!refresh_job.running && !netscan_job.running) unsetCursor();
+  if(ok) OnActionRefresh();
 }
 //-------------------------------------------------------------------------------------------------
 
 void MainWindow::OnActionNetworkScan()
 {
-  IF_REENTRY_RETURN();
-  setCursor(Qt::WaitCursor);
-  try { net_dev_map = network_scan(settings, net_if_list); }
-  catch(...) { log("Error: exception in network_scan()."); }
-  try { PopulateBlkListWidget(); }
-  catch(...) { log("Error: exception in PopulateBlkListWidget()."); }
-  unsetCursor();
+  if(netscan_job.running) return;
+  ui->actionNetworkScan->setEnabled(false);
+  auto job = [this, s = settings, ifl = net_if_list]
+   {
+    auto progress = [this](device_map batch)
+     {
+      QMetaObject::invokeMethod(this, [this, batch = std::move(batch)]() mutable
+                                { AddNetscanResults(std::move(batch)); }, Qt::QueuedConnection);
+     };
+    return make_shared<const device_map>(network_scan(s, ifl, progress));
+   };
+  RunInBackground(netscan_job, "network_scan", std::move(job),
+                  [this](shared_ptr<const device_map> res)
+   {
+    ui->actionNetworkScan->setEnabled(true);
+    if(!res) return;
+    device_map fresh = *res;
+    merge_netscan_results(fresh, net_dev_map, stoi(settings.netscan_cache_days));
+    net_dev_map = std::move(fresh);
+    try { PopulateBlkListWidget(); }
+    catch(...) { log("Error: exception in PopulateBlkListWidget()."); }
+   });
+}
+//-------------------------------------------------------------------------------------------------
+
+void MainWindow::AddNetscanResults(device_map batch)
+{
+  //results of previous scan stay until this one is complete
+  erase_if(net_dev_map, [&](const device_info& d)
+           { return ranges::any_of(batch, [&](auto& x) { return same_netdev(x, d); }); });
+  net_dev_map.insert(net_dev_map.end(), make_move_iterator(batch.begin()),
+                                        make_move_iterator(batch.end()));
+  ScheduleBlkListUpdate();
+}
+//-------------------------------------------------------------------------------------------------
+
+void MainWindow::ScheduleBlkListUpdate()
+{
+  if(exchange(blk_list_update_pending, true)) return;
+  QTimer::singleShot(200, this, [this]
+   {
+    blk_list_update_pending = false;
+    try { PopulateBlkListWidget(); }
+    catch(...) { log("Error: exception in PopulateBlkListWidget()."); }
+   });
+}
+//-------------------------------------------------------------------------------------------------
+
+void MainWindow::CheckNetscanCache()
+{
+  if(netscan_job.running || net_dev_map.empty()) return;
+  ui->actionNetworkScan->setEnabled(false);
+  auto job = [dmap = net_dev_map]() mutable
+   {
+    check_netscan_hosts(dmap, 1000);
+    return make_shared<const device_map>(std::move(dmap));
+   };
+  RunInBackground(netscan_job, "check_netscan_hosts", std::move(job),
+                  [this](shared_ptr<const device_map> res)
+   {
+    ui->actionNetworkScan->setEnabled(true);
+    if(!res) return;
+    net_dev_map = *res;
+    try { PopulateBlkListWidget(); }
+    catch(...) { log("Error: exception in PopulateBlkListWidget()."); }
+   });
+}
+//-------------------------------------------------------------------------------------------------
+
+void MainWindow::OnActionStop()
+{
+  for(bg_job* bj : {&refresh_job, &netscan_job, &mtp_job, &size_job})
+    if(bj->running) bj->worker.request_stop();
 }
 //-------------------------------------------------------------------------------------------------
 
@@ -427,17 +794,17 @@ void MainWindow::OnActionSave_by_Label()
 {
   mount_info info;
   if(!GatherMountInfo(info)) return;
-  if(!info.dev || info.dev->at("LABEL").empty())
+  if(!info.dev || info.dev->at(LABEL).empty())
    { log("Unknown label for device " + info.path + "!"); return; }
 
   mountopt_db_entry entry;
-  entry.fs_type    = info.fs_type;  entry.label   = info.dev->at("LABEL");
+  entry.fs_type    = info.fs_type;  entry.label   = info.dev->at(LABEL);
   entry.mountpoint = info.target;   entry.options = info.options;
 
   settings.options_db.emplace_back(std::move(entry));
 
 //  if(settings.save_settings(usr_info))
-    log("Options for '" + info.dev->at("LABEL") + "' has been saved.", "green");
+    log("Options for '" + info.dev->at(LABEL) + "' has been saved.", "green");
 }
 //-------------------------------------------------------------------------------------------------
 
@@ -445,17 +812,17 @@ void MainWindow::OnActionSave_by_UUID()
 {
   mount_info info;
   if(!GatherMountInfo(info)) return;
-  if(!info.dev || info.dev->at("UUID").empty())
+  if(!info.dev || info.dev->at(UUID).empty())
    { log("Unknown UUID for device " + info.path + "!"); return; }
 
   mountopt_db_entry entry;
-  entry.fs_type    = info.fs_type;  entry.uuid    = info.dev->at("UUID");
+  entry.fs_type    = info.fs_type;  entry.uuid    = info.dev->at(UUID);
   entry.mountpoint = info.target;   entry.options = info.options;
 
   settings.options_db.emplace_back(std::move(entry));
 
   //if(settings.save_settings(usr_info))
-    log("Options for '" + info.dev->at("UUID") + "' has been saved.", "green");
+    log("Options for '" + info.dev->at(UUID) + "' has been saved.", "green");
 }
 //-------------------------------------------------------------------------------------------------
 
@@ -25,6 +25,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 //-------------------------------------------------------------------------------------------------
 #include "base.h"
 #include "devmap.h"
+#include "sysinfo.h"
 #include "netmap.h"
 #include "mount.h"
 
@@ -32,6 +33,10 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <QTreeWidget>
 #include <QTextBrowser>
 #include <QFileSystemWatcher>
+#include <QSocketNotifier>
+#include <QTimer>
+#include <thread>
+#include <map>
 //-------------------------------------------------------------------------------------------------
 namespace Ui {
   class MainWindow;
@@ -59,8 +64,12 @@ private:
   std::string log_buffer;
   ///Main list of devices
   device_map main_dev_map;
+  ///main_dev_map by PATH, rebuilt by PopulateBlkListWidget()
+  device_index main_dev_index;
   ///Results of netscan
   device_map net_dev_map;
+  ///Device list update is scheduled
+  bool blk_list_update_pending = false;
   ///Systemd mount units
   mount_db system_db;
   ///List of netwotk interfaces
@@ -69,9 +78,57 @@ private:
   mount_helper mnt_helper;
 
   QFileSystemWatcher fsw;
+  ///Signals changes of /proc/self/mountinfo (POLLPRI)
+  QSocketNotifier* mnt_watch = nullptr;
+  ///Block and USB hotplug events (NETLINK_KOBJECT_UEVENT)
+  QSocketNotifier* uevent_watch = nullptr;
+  ///Events waiting to be applied to main_dev_map
+  std::vector<uevent> pending_uevents;
+  ///Re-reads free space of MTP devices
+  QTimer mtp_storage_timer;
+  static constexpr int mtp_storage_interval_ms = 60000;
+  ///SIZE of mounted network shares and MTP devices by (PATH, MOUNTPOINT), empty until known
+  std::map<std::pair<std::string, std::string>, std::string> mount_size_cache;
+
+  ///OnStartup() was called
+  bool started = false;
+  ///mount/umount command is running (see execute_async())
+  bool mount_running = false;
+
+  ///Scan running on a worker thread; request made while it runs is repeated after it.
+  struct bg_job { std::jthread worker; bool running = false, pending = false, busy_cursor = true; };
+  bg_job refresh_job, netscan_job, mtp_job{.busy_cursor = false}, //joined by ~MainWindow()
+         size_job{.busy_cursor = false};
+
+  /** @brief Run job() on bj's worker thread, then done(result) on GUI thread.
+   *  @details Result is default-constructed if job() throws.
+   */
+  template<class Job, class Done>
+  void RunInBackground(bg_job& bj, const char* name, Job job, Done done);
+
+  ///Apply pending_uevents to main_dev_map and device list.
+  void ApplyUevents();
+  ///Detect MTP devices in background, then AdoptMtpDevices().
+  void ScanMtpDevices();
+  ///Replace unmounted MTP device rows, update device list.
+  void AdoptMtpDevices(const device_map* mtp);
+  ///Replace system_db and main_dev_map with scan results, update device list.
+  void AdoptSnapshot(const system_snapshot* snap);
+  ///Set SIZE of mounted shares from mount_size_cache, read missing ones in background.
+  void FillMountSizes();
+  ///Called when mount/umount command has finished.
+  void MountFinished(bool ok);
 
   void UpdateStatusLabel(const std::string &text, const char* color);
   void PopulateBlkListWidget();
+  ///Update device list with a small delay, coalescing repeated requests.
+  void ScheduleBlkListUpdate();
+  ///Append shares found by running netscan, device list is updated with a small delay.
+  void AddNetscanResults(device_map batch);
+  ///Check if hosts of cached netscan results are reachable (in background).
+  void CheckNetscanCache();
+  ///Set column texts of the device list item.
+  void UpdateBlkListItem(QTreeWidgetItem* item, device_info& dev);
 
   ///Find options for the given device and show them in GUI.
   void PopulateFormFields(device_info& dev);
@@ -100,10 +157,15 @@ public slots:
     void ShowHelp(const QString&);
     void ShowLog(const QString& src);
     void FSWatch(const QString& path);
+    void OnStartup();
+    void OnMountTableChanged();
+    void OnUevent();
+    void OnMtpStorageTimer();
     void OnActionRefresh();
     void OnActionMount();
     void OnActionUnmount();
     void OnActionNetworkScan();
+    void OnActionStop();
     void OnActionSave_by_FS();
     void OnActionSave_by_Label();
     void OnActionSave_by_UUID();
@@ -0,0 +1,389 @@
+/* Copyright (c) 2015-2023 Kovshov K.A.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/** @file mdns_browse.cpp
+ *  @author Kovshov K.A. (kirillnow@gmail.com)
+ *  @brief Simple multicast DNS service discovery (DNS-SD) client.
+ *  @details RFC 6762 (mDNS), RFC 6763 (DNS-SD). Queries are sent from an ephemeral port
+ *  (one-shot queries, RFC 6762 5.1), so responders reply by unicast and a running
+ *  avahi-daemon is neither needed nor disturbed.
+ */
+//-------------------------------------------------------------------------------------------------
+
+#include "mdns_browse.h"
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+//forward declarations; project code should contain those
+void log(std::string s, const char* color);
+
+#define s_errno() string(strerror(errno))
+
+using namespace std;
+//-------------------------------------------------------------------------------------------------
+namespace {
+
+enum : uint16_t { T_A = 1, T_PTR = 12, T_TXT = 16, T_AAAA = 28, T_SRV = 33, C_IN = 1,
+                  MDNS_PORT = 5353 };
+using mdns_clock = chrono::steady_clock;
+
+///Lowercase ASCII copy, DNS names are case-insensitive.
+string name_key(string_view s)
+{
+  string r(s);
+  for(char& c : r) if(c >= 'A' && c <= 'Z') c += 'a' - 'A';
+  return r;
+}
+
+///First label of presentation format name ("My\.Server._smb._tcp.local"), unescaped.
+string first_label(string_view name)
+{
+  string r;
+  for(size_t i = 0; i < name.size() && name[i] != '.'; ++i)
+    r += (name[i] == '\\' && i + 1 < name.size()) ? name[++i] : name[i];
+  return r;
+}
+
+///Append presentation format name in wire format ('.' and '\' in labels are escaped).
+void put_name(string& b, string_view name)
+{
+  string label;
+  for(size_t i = 0; i <= name.size(); ++i)
+   {
+    if(i == name.size() || name[i] == '.')
+     {
+      if(label.size()) { b += char(min<size_t>(label.size(), 63)); b.append(label, 0, 63); }
+      label.clear();
+     }
+    else label += (name[i] == '\\' && i + 1 < name.size()) ? name[++i] : name[i];
+   }
+  b += '\0';
+}
+
+void put16(string& b, uint16_t v) { b += char(v >> 8); b += char(v); }
+void put32(string& b, uint32_t v) { put16(b, v >> 16); put16(b, v); }
+uint16_t get16(string_view m, size_t p) { return uint8_t(m[p]) << 8 | uint8_t(m[p + 1]); }
+uint32_t get32(string_view m, size_t p) { return uint32_t(get16(m, p)) << 16 | get16(m, p + 2); }
+
+///Read possibly compressed name at pos (advanced past it) in presentation format.
+bool get_name(string_view m, size_t& pos, string& out)
+{
+  out.clear();
+  size_t p = pos;
+  bool jumped = false;
+  for(int hops = 0;;)
+   {
+    if(p >= m.size()) return false;
+    const uint8_t len = m[p];
+    if((len & 0xC0) == 0xC0)
+     {
+      if(p + 1 >= m.size() || ++hops > 32) return false;
+      if(!jumped) pos = p + 2;
+      jumped = true;
+      p = (len & 0x3F) << 8 | uint8_t(m[p + 1]);
+      continue;
+     }
+    if(len & 0xC0) return false;
+    if(!len) { if(!jumped) pos = p + 1; return true; }
+    if(p + 1 + len > m.size() || out.size() > 1024) return false;
+    if(out.size()) out += '.';
+    for(char c : m.substr(p + 1, len)) { if(c == '.' || c == '\\') out += '\\'; out += c; }
+    p += 1 + len;
+   }
+}
+//-------------------------------------------------------------------------------------------------
+
+///Query message: all questions first, then known answers.
+struct mdns_query
+{
+  string b = string(12, '\0');
+  uint16_t qd = 0, an = 0;
+
+  void question(string_view name, uint16_t type)
+   { put_name(b, name); put16(b, type); put16(b, C_IN); ++qd; }
+  void known_ptr(string_view owner, string_view target, uint32_t ttl)
+  {
+    put_name(b, owner); put16(b, T_PTR); put16(b, C_IN); put32(b, ttl);
+    const size_t at = b.size();
+    put16(b, 0); put_name(b, target);
+    b[at] = char((b.size() - at - 2) >> 8); b[at + 1] = char(b.size() - at - 2);
+    ++an;
+  }
+  const string& finish(uint16_t id)
+  {
+    b[0] = char(id >> 8); b[1] = char(id);
+    b[4] = char(qd >> 8); b[5] = char(qd); b[6] = char(an >> 8); b[7] = char(an);
+    return b;
+  }
+};
+//-------------------------------------------------------------------------------------------------
+
+struct mdns_socket
+{
+  int fd = -1;
+  bool v6 = false;
+
+  mdns_socket() = default;
+  mdns_socket(mdns_socket&& r) :fd{r.fd}, v6{r.v6} { r.fd = -1; }
+
+  ~mdns_socket() { if(fd >= 0 && close(fd)) log("close(): " + s_errno(), "red"); }
+
+  bool setup(const net_interface& net)
+  {
+    v6 = !net.ip4;
+    const int ttl = 255, if_idx = net.idx; //RFC 6762 11: IP TTL 255
+
+    if((fd = socket(v6 ? AF_INET6 : AF_INET, SOCK_DGRAM|SOCK_CLOEXEC, IPPROTO_UDP)) < 0)
+     { log("socket(): " + s_errno(), "red"); return false; }
+    if(v6)
+     {
+      if(setsockopt(fd, IPPROTO_IPV6, IPV6_MULTICAST_IF, &if_idx, sizeof if_idx))
+       { log("setsockopt(IPV6_MULTICAST_IF): " + s_errno(), "red");   return false; }
+      if(setsockopt(fd, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &ttl, sizeof ttl))
+       { log("setsockopt(IPV6_MULTICAST_HOPS): " + s_errno(), "red"); return false; }
+     }
+    else
+     {
+      ip_mreqn mreq{{}, in_addr{net.ip4}, if_idx};
+      if(setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &mreq, sizeof mreq))
+       { log("setsockopt(IP_MULTICAST_IF): " + s_errno(), "red");     return false; }
+      if(setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof ttl))
+       { log("setsockopt(IP_MULTICAST_TTL): " + s_errno(), "red");    return false; }
+     }
+    return true; //ephemeral port is bound by the first sendto()
+  }
+  bool send(const std::string& data)
+  {
+    static const sockaddr_in  a4{AF_INET, htons(MDNS_PORT), {htonl(0xE00000FB)}}; //224.0.0.251
+    static const sockaddr_in6 a6{AF_INET6, htons(MDNS_PORT), 0,
+                                 {{{0xFF, 0x02, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFB}}}};
+    while(-1 == sendto(fd, data.data(), data.size(), 0,
+                       v6 ? (sockaddr*)&a6 : (sockaddr*)&a4, v6 ? sizeof a6 : sizeof a4))
+      if(errno != EINTR) { log("mDNS sendto(): " + s_errno(), "red"); return false; }
+    return true;
+  }
+  ///Empty data if nothing is pending or the packet is not from an mDNS responder.
+  bool receive(std::string& data)
+  {
+    sockaddr_storage a{};
+    socklen_t al = sizeof a;
+    int sz;
+    data.resize(9000); //RFC 6762 17
+    if((sz = recvfrom(fd, data.data(), data.size(), MSG_DONTWAIT, (sockaddr*)&a, &al)) <= 0)
+     {
+      data.clear();
+      if(sz == 0 || errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) return true;
+      log("recvfrom(): " + s_errno(), "red"); return false;
+     }
+    const uint16_t port = v6 ? ((sockaddr_in6&)a).sin6_port : ((sockaddr_in&)a).sin_port;
+    data.resize(ntohs(port) == MDNS_PORT ? sz : 0);
+    return true;
+  }
+};
+//-------------------------------------------------------------------------------------------------
+
+struct mdns_instance
+{
+  string name, type, target; ///<type is empty until PTR for the instance is received
+  uint16_t port = 0;
+  vector<string> txt;
+  bool have_srv = false, have_txt = false;
+  mdns_clock::time_point asked{};
+  unordered_set<string> reported;
+};
+
+struct mdns_host
+{
+  string name;
+  vector<string> ips;
+  mdns_clock::time_point asked{};
+};
+
+struct mdns_known_ptr { string type, instance; uint32_t ttl; mdns_clock::time_point at; };
+
+///Records from all responses.
+struct mdns_cache
+{
+  unordered_set<string> types; //keys of "_smb._tcp.local" etc.
+  unordered_map<string, mdns_instance> instances;
+  unordered_map<string, mdns_host> hosts;
+  vector<mdns_known_ptr> known;
+
+  bool parse(string_view m)
+  {
+    if(m.size() < 12) return false;
+    const uint16_t flags = get16(m, 2);
+    if(!(flags & 0x8000) || (flags & 0x000F)) return false; //not a response or error
+    const unsigned qd = get16(m, 4), rr = get16(m, 6) + get16(m, 8) + get16(m, 10);
+    size_t p = 12;
+    string owner, target;
+    for(unsigned i = 0; i < qd; ++i) if(!get_name(m, p, owner) || (p += 4) > m.size()) return false;
+    for(unsigned i = 0; i < rr; ++i)
+     {
+      if(!get_name(m, p, owner) || p + 10 > m.size()) return false;
+      const uint16_t type = get16(m, p), cls = get16(m, p + 2) & 0x7FFF, len = get16(m, p + 8);
+      const uint32_t ttl = get32(m, p + 4);
+      const size_t rd = p + 10;
+      if((p = rd + len) > m.size()) return false;
+      if(cls != C_IN) continue;
+      switch(type)
+       {
+        case T_PTR:
+         {
+          size_t q = rd;
+          if(!ttl || !get_name(m, q, target) || !types.contains(name_key(owner))) break;
+          mdns_instance& x = instances[name_key(target)];
+          if(x.type.empty())
+           {
+            x.name = target; x.type = name_key(owner.substr(0, owner.size() - 6)); //".local"
+            known.emplace_back(mdns_known_ptr{owner, target, ttl, mdns_clock::now()});
+           }
+          break;
+         }
+        case T_SRV:
+         {
+          size_t q = rd + 6;
+          if(len < 7 || !get_name(m, q, target)) break;
+          mdns_instance& x = instances[name_key(owner)];
+          x.name = owner; x.target = target; x.port = get16(m, rd + 4); x.have_srv = true;
+          break;
+         }
+        case T_TXT:
+         {
+          mdns_instance& x = instances[name_key(owner)];
+          x.txt.clear(); x.have_txt = true;
+          for(size_t q = rd; q < rd + len; q += 1 + uint8_t(m[q]))
+            if(q + 1 + uint8_t(m[q]) <= rd + len && m[q])
+              x.txt.emplace_back(m.substr(q + 1, uint8_t(m[q])));
+          break;
+         }
+        case T_A: case T_AAAA:
+         {
+          if(len != (type == T_A ? 4 : 16)) break;
+          char buf[INET6_ADDRSTRLEN];
+          if(!inet_ntop(type == T_A ? AF_INET : AF_INET6, m.data() + rd, buf, sizeof buf)) break;
+          mdns_host& h = hosts[name_key(owner)];
+          h.name = owner;
+          if(ranges::find(h.ips, buf) == h.ips.end()) h.ips.emplace_back(buf);
+          break;
+         }
+       }
+     }
+    return true;
+  }
+};
+
+} //namespace
+//-------------------------------------------------------------------------------------------------
+
+bool mdns_browse(const net_iface_list& if_list, const vector<string>& types,
+                 const mdns_found_fn& found, int wait_ms, const stop_token& stop)
+{
+  vector<mdns_socket> sockets; sockets.reserve(if_list.size());
+  vector<pollfd>      polls;   polls.reserve(if_list.size());
+  for(auto& x : if_list)
+   {
+    if(sockets.emplace_back(), !sockets.back().setup(x)) return false;
+    polls.emplace_back(pollfd{sockets.back().fd, POLLIN, 0});
+   }
+
+  mdns_cache c;
+  for(const string& t : types) c.types.insert(name_key(t + ".local"));
+  mt19937 rnd{random_device{}()};
+
+  auto send = [&](mdns_query& q)
+   {
+    if(!q.qd) return true;
+    const string& b = q.finish(uint16_t(rnd()));
+    for(auto& s : sockets) if(!s.send(b)) return false;
+    return true;
+   };
+
+  //ask what responders left out, report what is resolved
+  auto progress = [&](bool last)
+   {
+    const auto now = mdns_clock::now();
+    mdns_query q;
+    for(auto& [k, x] : c.instances)
+     {
+      if(x.type.empty()) continue;
+      if((!x.have_srv || !x.have_txt) && now - x.asked > 1s)
+       {
+        if(!x.have_srv) q.question(x.name, T_SRV);
+        if(!x.have_txt) q.question(x.name, T_TXT);
+        x.asked = now;
+       }
+      if(!x.have_srv) continue;
+      mdns_host& h = c.hosts[name_key(x.target)];
+      if(h.ips.empty() && now - h.asked > 1s)
+       { q.question(x.target, T_A); q.question(x.target, T_AAAA); h.asked = now; }
+      if(!x.have_txt && !last) continue;
+      for(const string& ip : h.ips) if(x.reported.insert(ip).second)
+        found(mdns_service{x.type, first_label(x.name), x.target, ip, x.port, x.txt});
+     }
+    return last || send(q);
+   };
+
+  string data;
+  const auto start = mdns_clock::now();
+  for(int n = 0; n < 3 && !stop.stop_requested(); ++n)
+   {
+    //PTR query, repeated with known answers that have more than half of TTL left (7.1)
+    mdns_query q;
+    for(const string& t : types) q.question(t + ".local", T_PTR);
+    for(auto& x : c.known)
+     {
+      auto left = x.ttl - chrono::duration_cast<chrono::seconds>(mdns_clock::now() - x.at).count();
+      if(left > x.ttl / 2 && q.b.size() < 1200) q.known_ptr(x.type, x.instance, uint32_t(left));
+     }
+    if(!send(q)) return false;
+
+    const auto until = start + chrono::milliseconds(wait_ms * (n + 1) / 3);
+    for(auto now = mdns_clock::now(); now < until && !stop.stop_requested(); now = mdns_clock::now())
+     {
+      int ms = int(chrono::duration_cast<chrono::milliseconds>(until - now).count()) + 1;
+      int sz = poll(polls.data(), polls.size(), min(ms, 100));
+      if(sz < 0 && errno != EINTR && errno != EAGAIN)
+       { log("poll(): " + s_errno(), "red"); return false; }
+      for(size_t i = 0; sz > 0 && i < sockets.size(); ++i)
+       {
+        if(!(polls[i].revents & POLLIN)) continue;
+        do
+         {
+          if(!sockets[i].receive(data)) return false;
+          if(data.size()) c.parse(data);
+         }
+        while(data.size());
+       }
+      if(sz > 0 && !progress(false)) return false;
+     }
+    if(!progress(false)) return false;
+   }
+  progress(true); //instances without TXT are reported too
+  return true;
+}
+//-------------------------------------------------------------------------------------------------
@@ -0,0 +1,55 @@
+/* Copyright (c) 2015-2023 Kovshov K.A.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/** @file mdns_browse.h
+ *  @author Kovshov K.A. (kirillnow@gmail.com)
+ *  @brief Simple multicast DNS service discovery (DNS-SD) client.
+ */
+
+#ifndef MDNS_BROWSE_H
+#define MDNS_BROWSE_H
+//-------------------------------------------------------------------------------------------------
+#include "wsd_probe.h"
+#include <string>
+#include <vector>
+#include <functional>
+#include <stop_token>
+#include <cstdint>
+
+struct mdns_service
+{
+  std::string type;     ///<lower case, e.g. "_smb._tcp"
+  std::string instance; ///<user-visible name, unescaped
+  std::string host;     ///<e.g. "nas.local"
+  std::string ip;
+  uint16_t port = 0;
+  std::vector<std::string> txt; ///<"key=value" strings
+};
+
+using mdns_found_fn = std::function<void(const mdns_service&)>;
+
+/** @brief Browse DNS-SD services of given types on all interfaces.
+ *  @details Sends one-shot (legacy unicast) PTR queries, repeated with known-answer
+ *  suppression, and asks SRV/TXT/A/AAAA for every new instance and host that responders
+ *  did not include in additional records. found() is called once per service address as soon
+ *  as it is resolved. Returns false on socket error (logged).
+ */
+bool mdns_browse(const net_iface_list& if_list, const std::vector<std::string>& types,
+                 const mdns_found_fn& found, int wait_ms = 3000,
+                 const std::stop_token& stop = {});
+//-------------------------------------------------------------------------------------------------
+#endif // MDNS_BROWSE_H
@@ -26,7 +26,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "common/regex.h"
 #include "common/path.h"
 #include "common/vect_op.h"
-#include "common/execute.h"
+#include "common/qexecute.h"
 #include "common/ucs.h"
 #include "common/str.h"
 
@@ -38,6 +38,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <cwctype>
 
 using namespace std;
+using enum device_info::column;
 //-------------------------------------------------------------------------------------------------
 
 bool contains_opt(std::string_view src, std::string_view opt) noexcept
@@ -70,8 +71,8 @@ std::string mount_helper::replace_placeholders(const std::string &str, const mou
   string name, path = sanitize_name(info.path);
   if((name = sanitize_name(filename(info.path))).empty())
    { name = path; }
-  string &lbl  = info.dev ? info.dev->at("LABEL") : name;
-  string &uuid = info.dev ? info.dev->at("UUID")  : name;
+  string &lbl  = info.dev ? info.dev->at(LABEL) : name;
+  string &uuid = info.dev ? info.dev->at(UUID)  : name;
   string slbl = sanitize_name(lbl);
   unordered_map<string, string> repl_hash =
    { {"d", name}, {"u", usr_info.user},
@@ -161,12 +162,12 @@ static vector<string> mtp_mount_cmd(mount_info& info)
   else { log("Unsupported mtpfs '" + info.fs_type + "'!"); return {}; }
 
   res += {info.target, "-o", info.options + &(",fsname="[info.options.empty()]) +
-          info.path + ":" + escape_fopt(info.dev->at("NAME")) + ",subtype=" + info.fs_type};
+          info.path + ":" + escape_fopt(info.dev->at(NAME)) + ",subtype=" + info.fs_type};
   return res;
 }
 //-------------------------------------------------------------------------------------------------
 
-bool mount_helper::mount(mount_info& info)
+bool mount_helper::mount(mount_info& info, done_fn done)
 {
   info.target  = replace_placeholders(info.target,  info);
   info.options = replace_placeholders(info.options, info);
@@ -187,7 +188,7 @@ bool mount_helper::mount(mount_info& info)
     contains_opt(info.options, "nodev") && !contains_opt(info.options, "suid")  &&
     !contains_opt(info.options, "dev")  && !contains_opt(info.options, "defaults");
 
-  const bool mtp = info.dev && !info.dev->at("_MTP").empty();
+  const bool mtp = info.dev && !info.dev->at(MTP).empty();
 
   const bool drop_priv = mtp || user_mount || !info.dev || (!nosuid && !mu_exact) ||
                          tl == TLVL_ASKPASS || (tl == TLVL_SYSTEMD && !mu_exact);
@@ -225,17 +226,21 @@ bool mount_helper::mount(mount_info& info)
   //TODO: handle FUSE non-root mounting
   //TODO: dump syslog tail if systemctl fails
 
-  if(execute(params, true, true)) return false;
-  //make sure automount activates
-  if(settings.use_systemctl && mu_exact)
-    { exists(info.target + "/."); }
-
-  log("Device " + info.path + " has been succefully mounted.", "green");
-  return true;
+  const bool automount = settings.use_systemctl && mu_exact;
+  return execute_async(params, [=, path = info.path, target = info.target](int status, auto&)
+   {
+    if(status) return done(false);
+    //make sure automount activates
+    if(automount)
+      { exists(target + "/."); }
+
+    log("Device " + path + " has been succefully mounted.", "green");
+    done(true);
+   }, true, true);
 }
 //-------------------------------------------------------------------------------------------------
 
-bool mount_helper::unmount(mount_info& info)
+bool mount_helper::unmount(mount_info& info, done_fn done)
 {
   info.target = replace_placeholders(info.target, info);
   mount_unit* mu = find_mount_unit(system_db, info);
@@ -249,10 +254,12 @@ bool mount_helper::unmount(mount_info& info)
   else
     params += {SYS_PREF"umount", "-v", info.target};
 
-  if(execute(params, true, true)) return false;
-
-  log("Device " + info.path + " has been succefully unmounted.", "green");
-  return true;
+  return execute_async(params, [=, path = info.path](int status, auto&)
+   {
+    if(status) return done(false);
+    log("Device " + path + " has been succefully unmounted.", "green");
+    done(true);
+   }, true, true);
 }
 //-------------------------------------------------------------------------------------------------
 
@@ -64,8 +64,12 @@ class mount_helper
 
     bool create_mountpoint(const std::string &target);
 
-    bool mount(mount_info& info);
-    bool unmount(mount_info& info);
+    ///Called from event loop when mount/umount command has finished, true on success.
+    using done_fn = std::function<void(bool)>;
+
+    ///Start mounting; returns false (`done` is never called then) if nothing was started.
+    bool mount(mount_info& info, done_fn done);
+    bool unmount(mount_info& info, done_fn done);
 
 };
 //-------------------------------------------------------------------------------------------------
@@ -23,43 +23,41 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include "netmap.h"
 #include "wsd_probe.h"
+#include "smb_shares.h"
+#include "nfs_exports.h"
+#include "port_probe.h"
+#include "mdns_browse.h"
+#include "dns_cache.h"
 #include "common/execute.h"
 #include "common/regex.h"
 #include "common/vect_op.h"
 #include <fstream>
-#include <charconv>
 #include <algorithm>
 #include <climits>
+#include <charconv>
+#include <ctime>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include <unordered_map>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <arpa/inet.h>
 
 using namespace std;
+using enum device_info::column;
 //-------------------------------------------------------------------------------------------------
-device_info devmap_init_columns();
 
 struct nmap_entry { std::string ip, host; bool smb, rpc, nfs; };
 struct net_share  { std::string ip, host, srvr, share, comment;
                     enum { SMB, NFS4, NFS } sh_type;          }; //NFS4 before NFS!
-//-------------------------------------------------------------------------------------------------
-
-static string unescape_dec(const string& str)
-{
-  string::size_type prev_pos = 0, pos = 0;
-  unsigned char v;
-  string res; res.reserve(str.size());
-  while( (pos = str.find('\\', prev_pos)) != string::npos )
-   {
-    if(str.size() - pos < 4) break;
-    res.append(str, prev_pos, pos - prev_pos);
-    if(from_chars(&str[pos+1], &str[pos+4], v, 10).ec == std::errc{})
-      res.push_back((char)v);
-    else res.push_back(' ');
-    prev_pos = pos + 4;
-   }
-  res.append(str, prev_pos, str.size() - prev_pos);
-  return res;
-}
+///Called by discovery backends for each host found (possibly from another thread).
+using host_found_fn = std::function<void(const nmap_entry&)>;
+///Called with shares found for a single host (possibly from another thread).
+using shares_found_fn = std::function<void(vector<net_share>)>;
 //-------------------------------------------------------------------------------------------------
 
 static pair<vector<string>, bool> nmap_targets(const string& targets, const net_iface_list& ifl)
@@ -78,7 +76,8 @@ static pair<vector<string>, bool> nmap_targets(const string& targets, const net_
 }
 //-------------------------------------------------------------------------------------------------
 
-static bool scan_nmap(const vector<string>& targets, bool ipv6, vector<nmap_entry> &out)
+static bool scan_nmap(const vector<string>& targets, bool ipv6, vector<nmap_entry> &out,
+                      const host_found_fn& found)
 {
   //using tmp file instead of std redirects to get 'interactive' output (-v --stats-every 10)
   char tmp[] = "/tmp/mount-gui.XXXXXX";
@@ -92,12 +91,14 @@ static bool scan_nmap(const vector<string>& targets, bool ipv6, vector<nmap_entr
     {BIN_NMAP, "--datadir", SHARE_NMAP, "-p", "445,111,2049", "-v", "--open",
      "--script", "smb-protocols", "--stats-every", "10", "--append-output", "-oG", tmp};
 
+  execute_timeout no_deadline{0}; //nmap takes long on large networks, Stop still works
   bool r = false;
   if(targets.size()) r |= !execute(params + targets, true, true);
-  if(ipv6) r |= !execute(params += {"-6", "--script-args", "newtargets", "--script",
-                                    "targets-ipv6-multicast-mld,targets-ipv6-multicast-echo"},
-                         true, true);
-  if(!r) return false;
+  if(ipv6 && !exec_limits.stop.stop_requested())
+    r |= !execute(params += {"-6", "--script-args", "newtargets", "--script",
+                             "targets-ipv6-multicast-mld,targets-ipv6-multicast-echo"},
+                  true, true);
+  if(!r && !exec_limits.stop.stop_requested()) return false; //partial results if cancelled
 
   ifstream file{tmp};
   if(!file) { log("Could not open temorary file: " + s_errno()); return false; }
@@ -109,64 +110,197 @@ static bool scan_nmap(const vector<string>& targets, bool ipv6, vector<nmap_entr
       auto& o = (out.emplace_back(nmap_entry{m[1], m[2]}), out.back());
       for(int i = 3; i < 6; ++i) if(m[i].matched) switch(stoi(m[i]))
        { case 445: o.smb = 1; break; case 111: o.rpc = 1; break; case 2049: o.nfs = 1; }
+      found(o);
      }
   return true;
 }
 //-------------------------------------------------------------------------------------------------
 
+///Built-in TCP probe of SMB and NFS ports; hostnames are looked up after the probe.
+static bool scan_ports(const vector<string>& targets, const program_settings& settings,
+                       vector<nmap_entry> &out, const host_found_fn& found)
+{
+  vector<uint32_t> hosts;
+  vector<string> skipped;
+  if(!expand_ipv4_targets(targets, hosts, &skipped))
+    for(const string& t : skipped)
+      log("Port probe: '" + t + "' is not an IPv4 address or network, skipped.", "");
+  if(hosts.empty()) return true;
+  log("Port probe: " + to_string(hosts.size()) + " hosts...", "");
+
+  port_probe_params pp;
+  pp.window = stoi(settings.probe_window);
+  pp.rate   = stoi(settings.probe_rate);
+  bool r = port_probe(hosts, {445, 111, 2049}, [&](const string& ip, unsigned open)
+   {
+    found(out.emplace_back(nmap_entry{ip, {}, bool(open & 1), bool(open & 2), bool(open & 4)}));
+   }, pp, exec_limits.stop);
+
+  string tmp;
+  for(nmap_entry& x : out) cached_host_name(x.ip, tmp); //start all lookups at once
+  for(nmap_entry& x : out) x.host = resolve_host_name(x.ip);
+  return r;
+}
+//-------------------------------------------------------------------------------------------------
+
 static void scan_shares(const nmap_entry& tgt, bool smb, bool nfs3, vector<net_share>& out)
 {
-  stringstream s_out; smatch m;
-  if(smb && tgt.smb && !execute({BIN_SMBCLIENT, "-NqgL", tgt.ip}, s_out))
-    for(string l; getline(s_out, l);)
+  cmatch m;
+  vector<smb_share> lst;
+  if(tgt.smb && smb_native_available() && smb_list_shares(tgt.ip, lst, exec_limits.timeout_ms))
+   {
+    for(smb_share& x : lst)
+      out.emplace_back(net_share{tgt.ip, tgt.host, {}, std::move(x.name), std::move(x.comment),
+                                 net_share::SMB});
+   }
+  else if(smb && tgt.smb) //smbclient is a fallback for libsmbclient too
+    execute_lines({BIN_SMBCLIENT, "-NqgL", tgt.ip}, [&](string_view l)
+     {
       if(regex_match(l, m, "\\s*Disk\\|\\s*([^|]+?)\\s*\\|\\s*(.*?)\\s*$"_re))
         out.emplace_back(net_share{tgt.ip, tgt.host, {}, m[1], m[2], net_share::SMB});
+     });
 
+  const int rpc_timeout = exec_limits.timeout_ms ? exec_limits.timeout_ms : 5000;
   if(tgt.nfs && !tgt.rpc)
-   { out.emplace_back(net_share{tgt.ip, tgt.host, {}, "/", {}, net_share::NFS4}); return; }
+   {
+    if(nfs4_ping(tgt.ip, rpc_timeout, exec_limits.stop))
+      out.emplace_back(net_share{tgt.ip, tgt.host, {}, "/", {}, net_share::NFS4});
+    return;
+   }
+  if(!tgt.nfs) return;
 
-  if(!nfs3 || !tgt.nfs) return;
-  if(!execute({BIN_SHOWMOUNT, "-e", "--no-headers", tgt.ip}, s_out = {}))
-    for(string l; getline(s_out, l);)
-      if(regex_match(l, m, "(.+)\\s+\\S+\\s*"_re))
-        out.emplace_back(net_share{tgt.ip, tgt.host, {}, m[1], {}, net_share::NFS});
+  vector<string> exports;
+  string err;
+  if(nfs_list_exports(tgt.ip, exports, rpc_timeout, err, exec_limits.stop))
+   {
+    for(string& x : exports)
+      out.emplace_back(net_share{tgt.ip, tgt.host, {}, std::move(x), {}, net_share::NFS});
+    return;
+   }
+  if(!nfs3) { log("Error: can't list NFS exports of " + tgt.ip + ", " + err, "orange"); return; }
+  //e.g. mountd is registered for UDP only
+  execute_lines({BIN_SHOWMOUNT, "-e", "--no-headers", tgt.ip}, [&](string_view l)
+   {
+    if(regex_match(l, m, "(.+)\\s+\\S+\\s*"_re))
+      out.emplace_back(net_share{tgt.ip, tgt.host, {}, m[1], {}, net_share::NFS});
+   });
 }
 //-------------------------------------------------------------------------------------------------
 
-static bool avahi_discover(vector<nmap_entry> &n_map, vector<net_share>& shares)
+static bool mdns_discover(const net_iface_list& ifl, vector<nmap_entry> &n_map,
+                          vector<net_share>& shares, const host_found_fn& found,
+                          const shares_found_fn& found_shares)
 {
   static constexpr auto NFS = net_share::NFS, NFS4 = net_share::NFS4;
-  stringstream s_out; smatch m;
-  if(!getuid()) execute({"systemctl", "start", "avahi-daemon"});
-  if(exists("/run/avahi-daemon/pid")) log("Avahi-Browse: ...", "");
-  if(execute({BIN_AVAHIB, "-artkp"}, s_out))
-   { log("Make sure avavi daemon is running."); return false; }
-  for(string l; getline(s_out, l);)
-    if(regex_match(l, m, "=;[^;]+;[^;]+;([^;]+);([^;]+);[^;]+;([^;]+);([^;]+);"
-                         "[^;]+;(?:[^;]*?\"path\\s*=\\s*([^\"]+?)\\s*\")?.*"_re))
+  log("mDNS: Browsing for SMB and NFS services...", "");
+  return mdns_browse(ifl, {"_smb._tcp", "_nfs._tcp"}, [&](const mdns_service& x)
+   {
+    if(x.type == "_smb._tcp")
+      found(n_map.emplace_back(nmap_entry{x.ip, x.host, true, false, false}));
+    else
      {
-      if(m[2] == "_smb._tcp")
-        n_map.emplace_back(nmap_entry{m[4], m[3], true, false, false});
-      else if(m[2] == "_nfs._tcp")
-        shares.emplace_back(net_share{m[4], m[3], {}, m[5].matched?unescape_dec(m[5]):"/",
-                                      unescape_dec(m[1]), m[5].matched ? NFS : NFS4});
-                                      //nfs3 advertising only '/' seems pretty unlikely
+      auto path = ranges::find_if(x.txt, [](auto& t) { return t.starts_with("path="); });
+      shares.emplace_back(net_share{x.ip, x.host, {}, path != x.txt.end() ? path->substr(5) : "/",
+                                    x.instance, path != x.txt.end() ? NFS : NFS4});
+                                    //nfs3 advertising only '/' seems pretty unlikely
+      found_shares({shares.back()});
      }
-  return true;
+   }, 3000, exec_limits.stop);
 }
 //-------------------------------------------------------------------------------------------------
 
-static bool wsd_discover(const net_iface_list& ifl, vector<nmap_entry> &n_map)
+static bool wsd_discover(const net_iface_list& ifl, vector<nmap_entry> &n_map,
+                         const host_found_fn& found)
 {
   wsd_dev_id_list lst;
   if(!wsd_probe(ifl, lst)) return false;
+  for(wsd_dev_id& x : lst) cached_host_name(x.ip, x.host); //start all lookups at once
+  for(wsd_dev_id& x : lst) x.host = resolve_host_name(x.ip);
   for(wsd_dev_id& x : lst)
-    get_host_name(x.ip, x.ip.find(':') != string::npos, x.host);
-  for(wsd_dev_id& x : lst)
-    n_map.emplace_back(nmap_entry{x.ip, x.host, true, false, false});
+    found(n_map.emplace_back(nmap_entry{x.ip, x.host, true, false, false}));
   return true;
 }
 //-------------------------------------------------------------------------------------------------
+
+/** @brief Share enumeration that starts for a host as soon as any backend reports it.
+ *  @details Up to max_parallel hosts are probed at once. A host reported again is probed
+ *  only for protocols that were not known before. Worker threads inherit exec_limits.
+ *  on_shares() is called by workers with the shares of each host as soon as it is probed.
+ */
+class share_prober
+{
+  mutex lock;
+  condition_variable cv;
+  deque<nmap_entry> queue;
+  unordered_map<string, nmap_entry> known; //by ip, flags merged from all reports
+  vector<pair<nmap_entry, vector<net_share>>> results;
+  bool closed = false;
+  const bool smb, nfs3;
+  const shares_found_fn& on_shares;
+  vector<jthread> pool; //last, joined first
+
+  void close()
+  {
+    { lock_guard l{lock}; closed = true; }
+    cv.notify_all();
+    pool.clear();
+  }
+
+  void worker()
+  {
+    for(;;)
+     {
+      unique_lock l{lock};
+      cv.wait(l, [this] { return closed || queue.size(); });
+      if(queue.empty()) return;
+      nmap_entry tgt = std::move(queue.front());
+      queue.pop_front();
+      l.unlock();
+
+      vector<net_share> res;
+      if(!exec_limits.stop.stop_requested())
+        try { scan_shares(tgt, smb, nfs3, res); }
+        catch(...) { log("Error: exception in scan_shares()."); }
+      if(res.size()) on_shares(res);
+      l.lock();
+      results.emplace_back(std::move(tgt), std::move(res));
+     }
+  }
+
+public:
+  share_prober(bool smb, bool nfs3, unsigned max_parallel, const shares_found_fn& on_shares)
+    :smb{smb}, nfs3{nfs3}, on_shares{on_shares}
+  {
+    for(unsigned i = 0; i < max(max_parallel, 1u); ++i)
+      pool.emplace_back([this, limits = exec_limits] { exec_limits = limits; worker(); });
+  }
+  ~share_prober() { close(); }
+
+  void add(const nmap_entry& x)
+  {
+    lock_guard l{lock};
+    nmap_entry& k = known.try_emplace(x.ip, nmap_entry{x.ip, x.host}).first->second;
+    if(k.host.empty()) k.host = x.host;
+    nmap_entry tgt{x.ip, k.host, x.smb && !k.smb, x.rpc || k.rpc, x.nfs && !k.nfs};
+    k.smb |= x.smb; k.rpc |= x.rpc; k.nfs |= x.nfs;
+    if(!tgt.smb && !tgt.nfs) return;
+    queue.push_back(std::move(tgt));
+    cv.notify_one();
+  }
+
+  ///Wait for queued probes; results are ordered by ip, not by completion time.
+  vector<net_share> finish()
+  {
+    close();
+    ranges::sort(results, [](auto& l, auto& r)
+     { return tie(l.first.ip, l.first.smb) < tie(r.first.ip, r.first.smb); });
+    vector<net_share> res;
+    for(auto& x : results) res.insert(res.end(), make_move_iterator(x.second.begin()),
+                                                 make_move_iterator(x.second.end()));
+    return res;
+  }
+};
+//-------------------------------------------------------------------------------------------------
 ///Replace hostname for all machine-local addresses.
 static void replace_local_hostname(const string& ip, string& host,
                                    const net_iface_list& ifl, const string& hostname)
@@ -222,67 +356,118 @@ static void collapse_share_list(vector<net_share>& lst, const net_iface_list& if
 }
 //-------------------------------------------------------------------------------------------------
 
-device_map network_scan(program_settings& settings, const net_iface_list& ifl)
+///Device list entries for collapsed share list (shares are moved from).
+static device_map shares_to_devices(vector<net_share>& shares)
 {
-  const bool have_avahi     = exists(BIN_AVAHIB),
-             have_smbclient = exists(BIN_SMBCLIENT),
+  device_map res;
+  for(auto& x : shares)
+   {
+    auto& d = (res.emplace_back(), res.back());
+    if(x.sh_type == net_share::SMB)
+     { d[PATH] = "//"; if(x.share[0] != '/') x.share.insert(0, 1, '/'); }
+    else { if(x.share[0] != ':') x.share.insert(0, 1, ':'); }
+
+    const char* tbl[] = {"cifs", "nfs4", "nfs"};
+    d[NETDEV]  = "1";                d[PATH]  += x.srvr + x.share;
+    d[NAME]    = std::move(x.share); d[HOST]   = std::move(x.host);
+    d[IP]      = std::move(x.ip);    d[PKNAME] = std::move(x.srvr);
+    d[FSTYPE]  = tbl[x.sh_type];     d[MODEL]  = std::move(x.comment);
+   }
+  return res;
+}
+//-------------------------------------------------------------------------------------------------
+
+device_map network_scan(const program_settings& settings, const net_iface_list& ifl,
+                        const netscan_progress_fn& progress)
+{
+  const bool have_smbclient = exists(BIN_SMBCLIENT),
              have_showmount = exists(BIN_SHOWMOUNT),
              have_nmap      = exists(BIN_NMAP);
   //No network interfaces was detected
-  if(!have_smbclient)
+  if(!have_smbclient && !smb_native_available())
     log("Smbclient was not found.\nSmbclient is required for finding SMB shares.");
-  if(!have_showmount && have_nmap && settings.use_nmap)
-    log("Showmount was not found.\n"
-        "Showmount (nfs-utils) is required for finding NFSv3 shares with nmap.");
   vector<nmap_entry> n_map;
   vector<net_share> shares;
   if(ifl.empty())
    {
     log("No network interfaces was detected.");
+    if(settings.use_avahi) log("Skipping mDNS discovery.", "");
     if(settings.use_wsd) log("Skipping WS-Discovery.", "");
     if(have_nmap && settings.use_nmap)
       log("Switching to IPv6 link-local scanning as fallback for nmap.", "");
    }
-  if(have_avahi && settings.use_avahi)
-    avahi_discover(n_map, shares);
-  if(ifl.size() && settings.use_wsd)
-    wsd_discover(ifl, n_map);
-  if(have_nmap && settings.use_nmap)
+  auto [targets, ipv6] = nmap_targets(settings.nmap_networks, ifl);
+  const bool use_nmap = have_nmap && settings.use_nmap;
+  if(settings.use_nmap && !have_nmap) log("Nmap was not found.", "orange");
+  if(ipv6 && !use_nmap && settings.use_probe)
+    log("IPv6 scanning requires nmap, only IPv4 networks are probed.", "orange");
+  //stuck commands are stopped; on cancellation whatever was found so far is returned
+  execute_timeout deadline{stoi(settings.netscan_timeout) * 1000};
+  const stop_token& stop = exec_limits.stop;
+
+  //discovery backends run concurrently, shares are enumerated as soon as a host is found
+  const shares_found_fn publish = [&](vector<net_share> batch)
    {
-    auto [tgt, ipv6] = nmap_targets(settings.nmap_networks, ifl);
-    scan_nmap(tgt, ipv6, n_map);
-   }
-  collapse_nmap_list(n_map);
-  for(auto& x : n_map) scan_shares(x, have_smbclient, have_showmount, shares);
+    if(!progress) return;
+    collapse_share_list(batch, ifl, settings.hostname);
+    progress(shares_to_devices(batch));
+   };
+  share_prober prober{have_smbclient, have_showmount, unsigned(stoi(settings.netscan_parallel)),
+                      publish};
+  const host_found_fn found = [&](const nmap_entry& x) { prober.add(x); };
+  vector<nmap_entry> mdns_map, wsd_map, probe_map, nmap_map;
+  mutex n_map_lock;
+  {
+    vector<jthread> backends;
+    //hosts of each backend are merged into n_map as soon as it returns
+    auto run = [&, limits = exec_limits](const char* name, vector<nmap_entry>& hosts, auto job)
+     {
+      backends.emplace_back([=, &hosts, &n_map, &n_map_lock]
+       {
+        exec_limits = limits;
+        try { job(); }
+        catch(...) { log("Error: exception in "s + name + "()."); }
+        lock_guard l{n_map_lock};
+        n_map << hosts;
+        collapse_nmap_list(n_map);
+        log(name + "(): "s + to_string(hosts.size()) + " hosts, " + to_string(n_map.size()) +
+            " found so far.", "");
+       });
+     };
+    if(ifl.size() && settings.use_avahi && !stop.stop_requested())
+      run("mdns_discover", mdns_map, [&] { mdns_discover(ifl, mdns_map, shares, found, publish); });
+    if(ifl.size() && settings.use_wsd && !stop.stop_requested())
+      run("wsd_discover", wsd_map, [&] { wsd_discover(ifl, wsd_map, found); });
+    if(settings.use_probe && targets.size() && !stop.stop_requested())
+      run("scan_ports", probe_map, [&] { scan_ports(targets, settings, probe_map, found); });
+    if(use_nmap && !stop.stop_requested())
+      run("scan_nmap", nmap_map, [&] { scan_nmap(targets, ipv6, nmap_map, found); });
+  } //joined
+  vector<net_share> probed = prober.finish();
+  shares.insert(shares.end(), make_move_iterator(probed.begin()), make_move_iterator(probed.end()));
+
+  //hostname reported by one backend is used for shares found through another one
+  for(net_share& x : shares) if(x.host.empty())
+    if(auto it = ranges::find(n_map, x.ip, &nmap_entry::ip); it != n_map.end())
+      x.host = it->host;
   collapse_share_list(shares, ifl, settings.hostname);
-  log("Network scan completed.", "green");
-  device_map res;
-  for(auto& x : shares)
-   {
-    auto& d = (res.emplace_back(devmap_init_columns()), res.back());
-    if(x.sh_type == net_share::SMB)
-     { d["PATH"] = "//"; if(x.share[0] != '/') x.share.insert(0, 1, '/'); }
-    else { if(x.share[0] != ':') x.share.insert(0, 1, ':'); }
-
-    const char* tbl[] = {"cifs", "nfs4", "nfs"};
-    d["_NETDEV"] = "1";                d["PATH"]  += x.srvr + x.share;
-    d["NAME"]    = std::move(x.share); d["HOST"]   = std::move(x.host);
-    d["IP"]      = std::move(x.ip);    d["PKNAME"] = std::move(x.srvr);
-    d["FSTYPE"]  = tbl[x.sh_type];     d["MODEL"]  = std::move(x.comment);
-   }
-  return res;
+  if(stop.stop_requested()) log("Network scan was stopped.", "orange");
+  else log("Network scan completed.", "green");
+  return shares_to_devices(shares);
 }
 //-------------------------------------------------------------------------------------------------
 
+///Never blocks: the missing part is empty until the lookup started here finishes.
 static pair<string,string> get_host_info(const string& addr)
 {
-  string host;
+  string host, ip;
   bool v4 = true, v6 = false;
   for(char c : addr) { if(c == ':') { v4 = false; v6 = true; break; }
                        if(!isdigit(c) && c != '.') { v4 = false;    } }
-  if((v4 || v6) && get_host_name(addr, v6, host))
-    return {addr, host};
-  return {get_host_addr(addr), addr};
+  if(v4 || v6)
+   { cached_host_name(addr, host); return {addr, host}; }
+  cached_host_addr(addr, ip);
+  return {ip, addr};
 }
 //-------------------------------------------------------------------------------------------------
 
@@ -291,16 +476,16 @@ void update_netdevs_values(device_map& configured, device_map& netscan,
 {
   for(auto& x : configured)
    {
-    if(x["_NETDEV"].empty()) continue;
+    if(x[NETDEV].empty()) continue;
 
-    string &comment = x["MODEL"],  &ip   = x["IP"],
-           &fstype  = x["FSTYPE"], &host = x["HOST"], shr = toupper(x["NAME"]);
+    string &comment = x[MODEL],  &ip   = x[IP],
+           &fstype  = x[FSTYPE], &host = x[HOST], shr = toupper(x[NAME]);
 
-    tie(ip, host) = get_host_info(x["PKNAME"]);
+    tie(ip, host) = get_host_info(x[PKNAME]);
     replace_local_hostname(ip, host, ifl, hostname);
     for(auto& y : netscan)
      {
-      string &y_ip = y["IP"], &y_host = y["HOST"];
+      string &y_ip = y[IP], &y_host = y[HOST];
       if(!(ip.size() && y_ip.size() && ip == y_ip) &&
          !(host.size() && y_host.size() && host == y_host))
         continue;
@@ -308,17 +493,93 @@ void update_netdevs_values(device_map& configured, device_map& netscan,
       //hostnames for mounted or preconfigured devices take precedence over resolved ones
       if(host.empty() && y_host.size()) host = y_host;
       else if(host.size() && host != y_host)
-        y["PKNAME"] = host; //leave ["HOST"] alone
+        y[PKNAME] = host; //leave [HOST] alone
 
-      if(netdev_type_eq(fstype, y["FSTYPE"]) && shr == toupper(y["NAME"]) &&
-         comment.size() < y["MODEL"].size())
-        comment = y["MODEL"];
+      if(netdev_type_eq(fstype, y[FSTYPE]) && shr == toupper(y[NAME]) &&
+         comment.size() < y[MODEL].size())
+        comment = y[MODEL];
      }
-    x["PKNAME"] = host.empty() ? ip : host;
+    x[PKNAME] = host.empty() ? ip : host;
+   }
+}
+//-------------------------------------------------------------------------------------------------
+
+bool same_netdev(const device_info& l, const device_info& r) noexcept
+{
+  return l.at(PATH) == r.at(PATH) && netdev_type_eq(l.at(FSTYPE), r.at(FSTYPE));
+}
+//-------------------------------------------------------------------------------------------------
+
+static bool is_stale(const device_info& d)
+{ const string* s = d.find("STALE"); return s && s->size(); }
+
+static time_t last_seen(const device_info& d)
+{
+  const string* s = d.find("SEEN");
+  time_t t = 0;
+  if(s) from_chars(s->data(), s->data() + s->size(), t);
+  return t;
+}
+//-------------------------------------------------------------------------------------------------
+
+device_map load_netscan_cache(const std::string& path, int ttl_days)
+{
+  if(ttl_days <= 0) return {};
+  device_map res = load_device_list(path);
+  const time_t now = time(nullptr);
+  erase_if(res, [&](const device_info& d)
+           { return d.at(NETDEV).empty() || last_seen(d) + ttl_days * 86400 < now; });
+  for(device_info& d : res) d["STALE"] = "1";
+  return res;
+}
+//-------------------------------------------------------------------------------------------------
+
+bool save_netscan_cache(device_map dmap, const std::string& path)
+{
+  const string now = to_string(time(nullptr));
+  for(device_info& d : dmap) if(!last_seen(d)) d["SEEN"] = now;
+  return save_device_list(dmap, path);
+}
+//-------------------------------------------------------------------------------------------------
+
+void merge_netscan_results(device_map& fresh, const device_map& prev, int ttl_days)
+{
+  const time_t now = time(nullptr);
+  for(device_info& d : fresh) { d["SEEN"] = to_string(now); d["STALE"].clear(); }
+  const size_t n = fresh.size();
+  for(const device_info& d : prev)
+   {
+    if(ttl_days <= 0 || last_seen(d) + ttl_days * 86400 < now) continue;
+    if(any_of(fresh.begin(), fresh.begin() + n, [&](auto& x) { return same_netdev(x, d); }))
+      continue;
+    fresh.push_back(d);
+    fresh.back()["STALE"] = "1";
    }
 }
 //-------------------------------------------------------------------------------------------------
 
+void check_netscan_hosts(device_map& dmap, int timeout_ms)
+{
+  static constexpr uint16_t ports[] = {445, 2049};
+  vector<uint32_t> hosts;
+  for(device_info& d : dmap)
+    if(in_addr a; is_stale(d) && inet_pton(AF_INET, d.at(IP).c_str(), &a) == 1)
+      hosts.push_back(ntohl(a.s_addr));
+  ranges::sort(hosts);
+  hosts.erase(unique(hosts.begin(), hosts.end()), hosts.end());
+
+  port_probe_params pp;
+  pp.init_timeout_ms = pp.max_timeout_ms = timeout_ms;
+  const string now = to_string(time(nullptr));
+  port_probe(hosts, {begin(ports), end(ports)}, [&](const string& ip, unsigned open)
+   {
+    for(device_info& d : dmap) if(is_stale(d) && d.at(IP) == ip)
+      if(open & (netdev_type_eq(d.at(FSTYPE), "cifs") ? 1 : 2))
+       { d["STALE"].clear(); d["SEEN"] = now; }
+   }, pp, exec_limits.stop);
+}
+//-------------------------------------------------------------------------------------------------
+
 bool netdev_type_eq(std::string_view l, std::string_view r) noexcept
 {
   size_t p1 = l.find(",."), p2 = r.find(",."); //"nfs,nfs4" "fuse.sshfs"
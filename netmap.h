@@ -26,9 +26,46 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "devmap.h"
 #include "wsd_probe.h"
 #include "base.h"
+#include <functional>
 
-device_map network_scan(program_settings& settings, const net_iface_list& ifl);
+///Receives shares found so far, may be called from worker threads.
+using netscan_progress_fn = std::function<void(device_map batch)>;
 
+/** @brief Find network shares with all enabled backends.
+ *  @details Shares are passed to progress() in small batches as soon as they are found;
+ *  the returned list is complete, merged and sorted.
+ */
+device_map network_scan(const program_settings& settings, const net_iface_list& ifl,
+                        const netscan_progress_fn& progress = {});
+
+///Same network share (PATH and compatible FSTYPE).
+bool same_netdev(const device_info& l, const device_info& r) noexcept;
+
+/** @brief Load cached netscan results.
+ *  @details Entries last seen (SEEN, unix time) more than ttl_days ago are dropped,
+ *  the rest are marked with STALE=1 until they are seen again.
+ */
+device_map load_netscan_cache(const std::string& path, int ttl_days);
+
+///Save netscan results; SEEN is set to the current time where it is missing.
+bool save_netscan_cache(device_map dmap, const std::string& path);
+
+/** @brief Merge results of completed scan with the previous ones.
+ *  @details Fresh entries get SEEN=now; previous entries not found again are kept as STALE
+ *  until ttl_days.
+ */
+void merge_netscan_results(device_map& fresh, const device_map& prev, int ttl_days);
+
+/** @brief Cheap reachability check instead of full rediscovery (IPv4 only).
+ *  @details TCP connect to 445 (cifs) or 2049 (nfs) of each STALE entry; reachable
+ *  entries are unmarked and their SEEN is updated.
+ */
+void check_netscan_hosts(device_map& dmap, int timeout_ms);
+
+/** @brief Fill host, address and comment of configured network shares from netscan results.
+ *  @details Never blocks: host lookups are cached, missing ones are started in background
+ *  (see dns_cache.h) and show up in a later call.
+ */
 void update_netdevs_values(device_map& configured, device_map& netscan,
                            const net_iface_list& ifl, const std::string& hostname);
 
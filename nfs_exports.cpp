@@ -0,0 +1,239 @@
+/* Copyright (c) 2015-2023 Kovshov K.A.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/** @file nfs_exports.cpp
+ *  @author Kovshov K.A. (kirillnow@gmail.com)
+ *  @brief Minimal ONC-RPC client for NFS export listing (showmount -e replacement).
+ *  @details RFC 5531 (RPC), RFC 1833 (portmapper), RFC 1813 appendix I (MOUNT v3).
+ *  Only AUTH_NONE calls over TCP with record marking are supported.
+ */
+//-------------------------------------------------------------------------------------------------
+
+#include "nfs_exports.h"
+#include <chrono>
+#include <atomic>
+#include <string_view>
+#include <cstdint>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#define s_errno() string(strerror(errno))
+
+using namespace std;
+//-------------------------------------------------------------------------------------------------
+namespace {
+
+enum : uint32_t { PMAP_PROG = 100000, PMAP_VERS = 2, PMAPPROC_GETPORT = 3, PMAP_PORT = 111,
+                  MOUNT_PROG = 100005, MOUNT_V3 = 3, MOUNTPROC3_EXPORT = 5,
+                  NFS_PROG = 100003, NFS_V4 = 4, NFS_PORT = 2049, PROC_NULL = 0,
+                  RPC_TCP = 6, MNTPATHLEN = 1024, MNTNAMLEN = 255 };
+constexpr size_t max_reply = 4 << 20;
+
+///XDR encoder, big-endian 32-bit words.
+struct xdr_out
+{
+  string b;
+  xdr_out& u32(uint32_t v) { v = htonl(v); b.append((const char*)&v, 4); return *this; }
+};
+
+///XDR decoder, `ok` is cleared on reading past the end or oversized strings.
+struct xdr_in
+{
+  string_view b;
+  bool ok = true;
+
+  uint32_t u32()
+  {
+    if(b.size() < 4) { ok = false; b = {}; return 0; }
+    uint32_t v; memcpy(&v, b.data(), 4); b.remove_prefix(4);
+    return ntohl(v);
+  }
+  string_view opaque(size_t max)
+  {
+    size_t n = u32(), padded = (n + 3) & ~size_t(3);
+    if(!ok || n > max || padded > b.size()) { ok = false; b = {}; return {}; }
+    string_view r = b.substr(0, n); b.remove_prefix(padded);
+    return r;
+  }
+};
+//-------------------------------------------------------------------------------------------------
+
+///Blocking-style RPC over non-blocking TCP socket, every step is bound by a common deadline.
+class rpc_conn
+{
+  using clock = chrono::steady_clock;
+  int fd = -1;
+  const clock::time_point deadline;
+  const stop_token& stop;
+
+  bool wait(short events, string& err)
+  {
+    for(;;)
+     {
+      if(stop.stop_requested()) { err = "cancelled"; return false; }
+      auto left = chrono::duration_cast<chrono::milliseconds>(deadline - clock::now()).count();
+      if(left <= 0) { err = "timed out"; return false; }
+      pollfd p = {fd, events, 0};
+      int rt = poll(&p, 1, int(min<decltype(left)>(left, 100))); //wake up for stop checks
+      if(rt > 0) return true;
+      if(rt < 0 && errno != EINTR) { err = "poll(2): " + s_errno(); return false; }
+     }
+  }
+
+  bool send_all(string_view b, string& err)
+  {
+    while(b.size())
+     {
+      ssize_t rt = ::send(fd, b.data(), b.size(), MSG_NOSIGNAL);
+      if(rt > 0) { b.remove_prefix(rt); continue; }
+      if(rt < 0 && errno == EINTR) continue;
+      if(rt < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && wait(POLLOUT, err)) continue;
+      if(err.empty()) err = "send(2): " + s_errno();
+      return false;
+     }
+    return true;
+  }
+
+  bool recv_all(char* p, size_t n, string& err)
+  {
+    while(n)
+     {
+      ssize_t rt = ::recv(fd, p, n, 0);
+      if(rt > 0) { p += rt; n -= rt; continue; }
+      if(rt == 0) { err = "connection closed"; return false; }
+      if(errno == EINTR) continue;
+      if((errno == EAGAIN || errno == EWOULDBLOCK) && wait(POLLIN, err)) continue;
+      if(err.empty()) err = "recv(2): " + s_errno();
+      return false;
+     }
+    return true;
+  }
+
+public:
+  rpc_conn(int timeout_ms, const stop_token& stop)
+    :deadline{clock::now() + chrono::milliseconds(timeout_ms)}, stop{stop} {}
+  rpc_conn(const rpc_conn&) = delete;
+  rpc_conn& operator=(const rpc_conn&) = delete;
+  ~rpc_conn() { if(fd >= 0) ::close(fd); }
+
+  bool connect(const string& ip, uint32_t port, string& err)
+  {
+    if(fd >= 0) { ::close(fd); fd = -1; }
+    const addrinfo hints{AI_NUMERICHOST|AI_NUMERICSERV, AF_UNSPEC, SOCK_STREAM, IPPROTO_TCP};
+    addrinfo* ai;
+    if(int e = getaddrinfo(ip.c_str(), to_string(port).c_str(), &hints, &ai))
+     { err = "getaddrinfo(3): "s + gai_strerror(e); return false; }
+    fd = socket(ai->ai_family, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, IPPROTO_TCP);
+    int rt = fd < 0 ? -1 : ::connect(fd, ai->ai_addr, ai->ai_addrlen);
+    freeaddrinfo(ai);
+    if(fd < 0) { err = "socket(2): " + s_errno(); return false; }
+    if(rt && errno != EINPROGRESS) { err = "connect(2): " + s_errno(); return false; }
+    if(rt && !wait(POLLOUT, err)) return false;
+    int e = 0; socklen_t len = sizeof e;
+    if(getsockopt(fd, SOL_SOCKET, SO_ERROR, &e, &len) || e)
+     { err = "connect(2): "s + strerror(e ? e : errno); return false; }
+    return true;
+  }
+
+  ///Call procedure with AUTH_NONE, `reply` receives procedure results on success.
+  bool call(uint32_t prog, uint32_t vers, uint32_t proc, string_view args, string& reply,
+            string& err)
+  {
+    static atomic<uint32_t> next_xid = uint32_t(clock::now().time_since_epoch().count());
+    const uint32_t xid = next_xid++;
+    xdr_out m;
+    m.u32(0).u32(xid).u32(0 /*CALL*/).u32(2 /*RPC version*/).u32(prog).u32(vers).u32(proc)
+     .u32(0).u32(0).u32(0).u32(0); //credentials and verifier: AUTH_NONE
+    m.b += args;
+    const uint32_t mark = htonl(0x80000000u | uint32_t(m.b.size() - 4)); //last fragment
+    memcpy(m.b.data(), &mark, 4);
+    if(!send_all(m.b, err)) return false;
+
+    reply.clear();
+    for(uint32_t hdr = 0; !(hdr & 0x80000000u); )
+     {
+      if(!recv_all((char*)&hdr, 4, err)) return false;
+      hdr = ntohl(hdr);
+      const size_t len = hdr & 0x7fffffffu, at = reply.size();
+      if(at + len > max_reply) { err = "reply is too large"; return false; }
+      reply.resize(at + len);
+      if(!recv_all(reply.data() + at, len, err)) return false;
+     }
+
+    xdr_in r{reply};
+    if(r.u32() != xid || r.u32() != 1 /*REPLY*/) { err = "unexpected RPC message"; return false; }
+    if(r.u32() != 0 /*MSG_ACCEPTED*/) { err = "RPC call denied"; return false; }
+    r.u32(); r.opaque(400); //verifier
+    switch(uint32_t st = r.u32(); r.ok ? st : ~0u)
+     {
+      case 0: break;
+      case 1: err = "program unavailable"; return false;
+      case 2: err = "program version mismatch"; return false;
+      case 3: err = "procedure unavailable"; return false;
+      default: err = "RPC call failed"; return false;
+     }
+    reply.erase(0, reply.size() - r.b.size());
+    return true;
+  }
+};
+
+} //namespace
+//-------------------------------------------------------------------------------------------------
+
+bool nfs_list_exports(const string& ip, vector<string>& out, int timeout_ms, string& err,
+                      const stop_token& stop)
+{
+  rpc_conn c{timeout_ms, stop};
+  string reply;
+  const string args = xdr_out{}.u32(MOUNT_PROG).u32(MOUNT_V3).u32(RPC_TCP).u32(0).b;
+  if(!c.connect(ip, PMAP_PORT, err) ||
+     !c.call(PMAP_PROG, PMAP_VERS, PMAPPROC_GETPORT, args, reply, err))
+   { err = "portmapper: " + err; return false; }
+
+  xdr_in r{reply};
+  const uint32_t port = r.u32();
+  if(!r.ok || !port || port > 65535) { err = "mountd is not registered for TCP"; return false; }
+
+  if(!c.connect(ip, port, err) || !c.call(MOUNT_PROG, MOUNT_V3, MOUNTPROC3_EXPORT, {}, reply, err))
+   { err = "mountd: " + err; return false; }
+
+  //exports: list of {dirpath, list of group names}
+  vector<string> lst;
+  for(r = xdr_in{reply}; r.u32() && r.ok; )
+   {
+    string_view dir = r.opaque(MNTPATHLEN);
+    while(r.u32() && r.ok) r.opaque(MNTNAMLEN);
+    if(r.ok) lst.emplace_back(dir);
+   }
+  if(!r.ok) { err = "mountd: malformed reply"; return false; }
+  out.insert(out.end(), make_move_iterator(lst.begin()), make_move_iterator(lst.end()));
+  return true;
+}
+//-------------------------------------------------------------------------------------------------
+
+bool nfs4_ping(const string& ip, int timeout_ms, const stop_token& stop)
+{
+  rpc_conn c{timeout_ms, stop};
+  string reply, err;
+  return c.connect(ip, NFS_PORT, err) && c.call(NFS_PROG, NFS_V4, PROC_NULL, {}, reply, err);
+}
+//-------------------------------------------------------------------------------------------------
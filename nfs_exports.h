@@ -0,0 +1,41 @@
+/* Copyright (c) 2015-2023 Kovshov K.A.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/** @file nfs_exports.h
+ *  @author Kovshov K.A. (kirillnow@gmail.com)
+ *  @brief Minimal ONC-RPC client for NFS export listing (showmount -e replacement).
+ */
+
+#ifndef NFS_EXPORTS_H
+#define NFS_EXPORTS_H
+//-------------------------------------------------------------------------------------------------
+#include <string>
+#include <vector>
+#include <stop_token>
+
+/** @brief List NFSv3 exports of a host: portmapper GETPORT, then MOUNTPROC3_EXPORT over TCP.
+ *  @details Thread-safe, nothing is logged; errors are returned in `err`.
+ *  @param timeout_ms Limit for the whole exchange.
+ *  Returns false if the host is unreachable, has no mountd on TCP, or the reply is malformed.
+ */
+bool nfs_list_exports(const std::string& ip, std::vector<std::string>& out, int timeout_ms,
+                      std::string& err, const std::stop_token& stop = {});
+
+///True if the host answers NFS version 4 NULL procedure on port 2049.
+bool nfs4_ping(const std::string& ip, int timeout_ms, const std::stop_token& stop = {});
+//-------------------------------------------------------------------------------------------------
+#endif // NFS_EXPORTS_H
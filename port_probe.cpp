@@ -0,0 +1,278 @@
+/* Copyright (c) 2015-2023 Kovshov K.A.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/** @file port_probe.cpp
+ *  @author Kovshov K.A. (kirillnow@gmail.com)
+ *  @brief Non-blocking TCP connect() port prober (nmap -sT replacement for a few ports).
+ */
+//-------------------------------------------------------------------------------------------------
+
+#include "port_probe.h"
+#include <chrono>
+#include <charconv>
+#include <algorithm>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+//forward declarations; project code should contain those
+void log(std::string s, const char* color);
+
+#define s_errno() string(strerror(errno))
+
+using namespace std;
+//-------------------------------------------------------------------------------------------------
+
+///Parse "a" or "a-b" octet range.
+static bool parse_octet(string_view s, unsigned& lo, unsigned& hi)
+{
+  const char* e = s.data() + s.size();
+  auto r = from_chars(s.data(), e, lo);
+  hi = lo;
+  if(r.ec == errc{} && r.ptr != e && *r.ptr == '-') r = from_chars(r.ptr + 1, e, hi);
+  return r.ec == errc{} && r.ptr == e && lo <= hi && hi <= 255;
+}
+//-------------------------------------------------------------------------------------------------
+
+/** @brief Expand single target, nothing is added if it's not expanded.
+ *  @return 1 - expanded, 0 - not an IPv4 address, range or network, -1 - more addresses
+ *  than a /min_prefix network.
+ */
+static int expand_ipv4_target(string_view s, vector<uint32_t>& out, unsigned min_prefix)
+{
+  string_view mask;
+  if(size_t p = s.find('/'); p != s.npos) { mask = s.substr(p + 1); s = s.substr(0, p); }
+
+  unsigned lo[4], hi[4];
+  if(ranges::count(s, '.') != 3) return 0;
+  for(unsigned i = 0; i < 4; ++i)
+   {
+    size_t e = min(s.find('.'), s.size());
+    if(!parse_octet(s.substr(0, e), lo[i], hi[i])) return 0;
+    s.remove_prefix(min(e + 1, s.size()));
+   }
+
+  if(mask.size())
+   {
+    unsigned bits;
+    auto r = from_chars(mask.data(), mask.data() + mask.size(), bits);
+    if(r.ec != errc{} || r.ptr != mask.data() + mask.size() || bits > 32) return 0;
+    for(unsigned i = 0; i < 4; ++i) if(lo[i] != hi[i]) return 0;
+    if(bits < min_prefix) return -1;
+    const uint32_t ip = lo[0] << 24 | lo[1] << 16 | lo[2] << 8 | lo[3],
+                   net_mask = bits == 32 ? ~0u : ~(~0u >> bits),
+                   first = ip & net_mask, last = first | ~net_mask;
+    if(bits >= 31) { for(uint64_t a = first; a <= last; ++a) out.push_back(a); }
+    else for(uint32_t a = first + 1; a < last; ++a) out.push_back(a);
+    return 1;
+   }
+  uint64_t n = 1;
+  for(unsigned i = 0; i < 4; ++i) n *= hi[i] - lo[i] + 1;
+  if(n > uint64_t(1) << (32 - min(min_prefix, 32u))) return -1;
+  for(unsigned a = lo[0]; a <= hi[0]; ++a) for(unsigned b = lo[1]; b <= hi[1]; ++b)
+    for(unsigned c = lo[2]; c <= hi[2]; ++c) for(unsigned d = lo[3]; d <= hi[3]; ++d)
+      out.push_back(a << 24 | b << 16 | c << 8 | d);
+  return 1;
+}
+//-------------------------------------------------------------------------------------------------
+
+bool expand_ipv4_targets(const vector<string>& targets, vector<uint32_t>& out,
+                         vector<string>* skipped, unsigned min_prefix)
+{
+  bool all = true;
+  for(const string& t : targets)
+    switch(expand_ipv4_target(t, out, min_prefix))
+     {
+      case 0: all = false; if(skipped) skipped->push_back(t); break;
+      case -1:
+        all = false;
+        log("Port probe: '" + t + "' is larger than a /" + to_string(min_prefix) +
+            " network, skipped.", "orange");
+     }
+  //keep the first occurrence, so the order of targets is preserved
+  vector<uint32_t> seen = out;
+  ranges::sort(seen);
+  vector<bool> used(seen.size());
+  erase_if(out, [&](uint32_t a)
+   {
+    size_t i = ranges::lower_bound(seen, a) - seen.begin();
+    return used[i] ? true : (used[i] = true, false);
+   });
+  return all;
+}
+//-------------------------------------------------------------------------------------------------
+namespace {
+
+using pp_clock = chrono::steady_clock;
+
+struct pp_host
+{
+  unsigned pending = 0, open_mask = 0;
+  bool down = false;
+  float rtt_ms = -1; ///<-1 - no reply yet
+};
+
+struct pp_slot
+{
+  int fd = -1;
+  uint32_t host;
+  unsigned port;
+  pp_clock::time_point start, deadline;
+};
+
+} //namespace
+//-------------------------------------------------------------------------------------------------
+
+bool port_probe(const vector<uint32_t>& hosts, const vector<uint16_t>& ports,
+                const port_probe_fn& on_host, const port_probe_params& params,
+                const stop_token& stop)
+{
+  if(ports.empty() || ports.size() > 32) return false;
+  const size_t n_ports = ports.size(), total = hosts.size() * n_ports;
+  if(!total) return true;
+
+  int ep = epoll_create1(EPOLL_CLOEXEC);
+  if(ep < 0) { log("Error: epoll_create1(2): " + s_errno(), "red"); return false; }
+
+  //leave some descriptors to the rest of the program
+  unsigned window = max(params.window, 1u);
+  if(rlimit rl; !getrlimit(RLIMIT_NOFILE, &rl) && rl.rlim_cur != RLIM_INFINITY)
+    window = unsigned(clamp<rlim_t>(rl.rlim_cur / 2, 1, window));
+
+  vector<pp_host> hs(hosts.size());
+  vector<pp_slot> slots(window);
+  vector<unsigned> free_slots(window);
+  for(unsigned i = 0; i < window; ++i) free_slots[i] = window - 1 - i;
+
+  float srtt = -1, rttvar = 0; //over all hosts
+  auto timeout_for = [&](const pp_host& h)
+   {
+    float t = h.rtt_ms >= 0 ? 4 * h.rtt_ms + 10
+            : srtt >= 0 ? max<float>(srtt + 4 * rttvar, params.min_timeout_ms)
+                        : params.init_timeout_ms;
+    return chrono::milliseconds(int(min<float>(t, params.max_timeout_ms)));
+   };
+
+  auto settle = [&](uint32_t h, unsigned port, int err, pp_clock::duration rtt)
+   {
+    pp_host& x = hs[h];
+    if(!err) x.open_mask |= 1u << port;
+    if(!err || err == ECONNREFUSED)
+     {
+      float ms = chrono::duration<float, milli>(rtt).count();
+      x.rtt_ms = x.rtt_ms < 0 ? ms : min(x.rtt_ms, ms);
+      if(srtt < 0) { srtt = ms; rttvar = ms / 2; }
+      else { rttvar = 0.75f * rttvar + 0.25f * abs(srtt - ms); srtt = 0.875f * srtt + 0.125f * ms; }
+      //the host replied: other probes to it don't have to wait for the generic timeout
+      for(pp_slot& s : slots) if(s.fd >= 0 && s.host == h)
+        s.deadline = min(s.deadline, s.start + timeout_for(x));
+     }
+    else if(err == EHOSTUNREACH || err == ENETUNREACH || err == EHOSTDOWN) x.down = true;
+    if(!--x.pending && x.open_mask)
+     {
+      in_addr a{htonl(hosts[h])};
+      char buf[INET_ADDRSTRLEN];
+      on_host(inet_ntop(AF_INET, &a, buf, sizeof buf), x.open_mask);
+     }
+   };
+
+  auto finish = [&](unsigned i, int err, pp_clock::time_point now)
+   {
+    pp_slot& s = slots[i];
+    if(!err) //reset instead of FIN, so no TIME_WAIT is left behind
+     { linger l{1, 0}; setsockopt(s.fd, SOL_SOCKET, SO_LINGER, &l, sizeof l); }
+    ::close(s.fd); s.fd = -1;
+    free_slots.push_back(i);
+    settle(s.host, s.port, err, now - s.start);
+   };
+
+  bool ok = true;
+  size_t next = 0;
+  double tokens = 1;
+  auto last_refill = pp_clock::now();
+  epoll_event ev[64];
+  while(ok && (next < total || free_slots.size() < window))
+   {
+    if(stop.stop_requested()) break;
+    auto now = pp_clock::now();
+    if(params.rate)
+     {
+      tokens = min<double>(tokens + chrono::duration<double>(now - last_refill).count()
+                                    * params.rate, max(params.rate / 50u, 1u));
+      last_refill = now;
+     }
+
+    for(; next < total && free_slots.size() && (!params.rate || tokens >= 1); ++next)
+     {
+      const uint32_t h = uint32_t(next / n_ports);
+      const unsigned port = unsigned(next % n_ports);
+      if(!port) hs[h].pending = unsigned(n_ports);
+      if(hs[h].down) { settle(h, port, EHOSTUNREACH, {}); continue; }
+
+      int fd = socket(AF_INET, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, IPPROTO_TCP);
+      if(fd < 0 && (errno == EMFILE || errno == ENFILE) && free_slots.size() < window)
+        break; //wait for some probes to finish
+      if(fd < 0) { log("Error: socket(2): " + s_errno(), "red"); ok = false; break; }
+
+      tokens -= 1;
+      const sockaddr_in a{AF_INET, htons(ports[port]), {htonl(hosts[h])}};
+      int rt = ::connect(fd, (const sockaddr*)&a, sizeof a);
+      if(rt && errno == EINPROGRESS)
+       {
+        const unsigned i = free_slots.back();
+        epoll_event e{EPOLLOUT, {.u32 = i}};
+        if(epoll_ctl(ep, EPOLL_CTL_ADD, fd, &e))
+         { log("Error: epoll_ctl(2): " + s_errno(), "red"); ::close(fd); ok = false; break; }
+        free_slots.pop_back();
+        slots[i] = pp_slot{fd, h, port, now, now + timeout_for(hs[h])};
+        continue;
+       }
+      const int err = rt ? errno : 0;
+      ::close(fd);
+      settle(h, port, err, pp_clock::now() - now);
+     }
+
+    //sleep until the nearest deadline, but wake up for stop and rate limit checks
+    auto wake = now + chrono::milliseconds(50);
+    for(const pp_slot& s : slots) if(s.fd >= 0) wake = min(wake, s.deadline);
+    int wait_ms = int(chrono::ceil<chrono::milliseconds>(wake - now).count());
+    if(params.rate && next < total && free_slots.size())
+      wait_ms = min(wait_ms, int(1000 / params.rate) + 1);
+
+    int n = epoll_wait(ep, ev, size(ev), max(wait_ms, 0));
+    if(n < 0 && errno != EINTR) { log("Error: epoll_wait(2): " + s_errno(), "red"); ok = false; }
+    now = pp_clock::now();
+    for(int k = 0; k < n; ++k)
+     {
+      const unsigned i = ev[k].data.u32;
+      int err = 0; socklen_t len = sizeof err;
+      if(getsockopt(slots[i].fd, SOL_SOCKET, SO_ERROR, &err, &len)) err = errno;
+      finish(i, err, now);
+     }
+    for(unsigned i = 0; i < window; ++i)
+      if(slots[i].fd >= 0 && slots[i].deadline <= now) finish(i, ETIMEDOUT, now);
+   }
+  for(pp_slot& s : slots) if(s.fd >= 0) ::close(s.fd);
+  ::close(ep);
+  return ok;
+}
+//-------------------------------------------------------------------------------------------------
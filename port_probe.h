@@ -0,0 +1,64 @@
+/* Copyright (c) 2015-2023 Kovshov K.A.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/** @file port_probe.h
+ *  @author Kovshov K.A. (kirillnow@gmail.com)
+ *  @brief Non-blocking TCP connect() port prober (nmap -sT replacement for a few ports).
+ */
+
+#ifndef PORT_PROBE_H
+#define PORT_PROBE_H
+//-------------------------------------------------------------------------------------------------
+#include <string>
+#include <vector>
+#include <functional>
+#include <stop_token>
+#include <cstdint>
+
+struct port_probe_params
+{
+  unsigned window = 256;        ///<connections in flight
+  unsigned rate = 2000;         ///<new connections per second, 0 - unlimited
+  int init_timeout_ms = 1000;   ///<until the first reply is received
+  int min_timeout_ms = 100;     ///<for hosts that have not replied yet
+  int max_timeout_ms = 1500;
+};
+
+///Called for each host with open ports: ip, bit i of open_mask is set if ports[i] is open.
+using port_probe_fn = std::function<void(const std::string& ip, unsigned open_mask)>;
+
+/** @brief Expand nmap-style IPv4 targets ("192.168.0.1/24", "192.168.1.1-64", "10.0.1-3.1").
+ *  @details Network and broadcast addresses of CIDR blocks are skipped, duplicates removed.
+ *  Targets that are not IPv4 addresses, ranges or networks (host names, IPv6) are skipped
+ *  and added to `skipped`. Networks and ranges with more addresses than a /min_prefix network
+ *  are skipped with a log line. The rest is still expanded; false is returned if anything
+ *  was skipped.
+ */
+bool expand_ipv4_targets(const std::vector<std::string>& targets, std::vector<uint32_t>& out,
+                         std::vector<std::string>* skipped = nullptr, unsigned min_prefix = 16);
+
+/** @brief Probe up to 32 TCP ports on each host with non-blocking connect() and epoll.
+ *  @details Hosts are probed in order, all ports of a host at once. Timeouts adapt to round
+ *  trip times: globally (smoothed, RFC 6298 style) and per host, once it replied with SYN-ACK
+ *  or RST. on_host() is called as soon as all ports of a host are settled.
+ *  Returns false on system error (logged).
+ */
+bool port_probe(const std::vector<uint32_t>& hosts, const std::vector<uint16_t>& ports,
+                const port_probe_fn& on_host, const port_probe_params& params = {},
+                const std::stop_token& stop = {});
+//-------------------------------------------------------------------------------------------------
+#endif // PORT_PROBE_H
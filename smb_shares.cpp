@@ -0,0 +1,114 @@
+/* Copyright (c) 2015-2023 Kovshov K.A.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/** @file smb_shares.cpp
+ *  @author Kovshov K.A. (kirillnow@gmail.com)
+ *  @brief In-process SMB share enumeration (libsmbclient).
+ */
+//-------------------------------------------------------------------------------------------------
+
+#include "smb_shares.h"
+#include <string.h>
+#include <errno.h>
+#ifdef HAVE_LIBSMBCLIENT
+  #include <libsmbclient.h>
+  #include <mutex>
+#endif
+
+//forward declarations; project code should contain those
+void log(std::string s, const char* color);
+
+#define s_errno() string(strerror(errno))
+
+using namespace std;
+//-------------------------------------------------------------------------------------------------
+#ifdef HAVE_LIBSMBCLIENT
+
+///Anonymous login, as smbclient -N.
+static void smb_auth_anon(const char*, const char*, char* wg, int wglen, char* un, int unlen,
+                          char* pw, int pwlen)
+{
+  if(wglen > 0) wg[0] = 0;
+  if(unlen > 0) un[0] = 0;
+  if(pwlen > 0) pw[0] = 0;
+}
+//-------------------------------------------------------------------------------------------------
+
+///libsmbclient context, freed on scope exit.
+struct smb_context
+{
+  SMBCCTX* ctx = nullptr;
+
+  explicit smb_context(int timeout_ms)
+  {
+    static once_flag thread_init;
+    call_once(thread_init, smbc_thread_posix);
+    if(!(ctx = smbc_new_context())) return;
+    smbc_setDebug(ctx, 0);
+    smbc_setFunctionAuthData(ctx, smb_auth_anon);
+    smbc_setOptionUseKerberos(ctx, false);
+    smbc_setOptionNoAutoAnonymousLogin(ctx, false);
+    if(timeout_ms > 0) smbc_setTimeout(ctx, timeout_ms);
+    if(!smbc_init_context(ctx)) { smbc_free_context(ctx, 1); ctx = nullptr; }
+  }
+  ~smb_context() { if(ctx) smbc_free_context(ctx, 1); }
+  smb_context(const smb_context&) = delete;
+  smb_context& operator=(const smb_context&) = delete;
+  explicit operator bool() const { return ctx; }
+};
+//-------------------------------------------------------------------------------------------------
+
+bool smb_native_available()
+{
+  static const bool ok = []
+   {
+    smb_context c{0};
+    if(!c) log("Error: libsmbclient initialization failed, using smbclient.", "orange");
+    return bool(c);
+   }();
+  return ok;
+}
+//-------------------------------------------------------------------------------------------------
+
+bool smb_list_shares(const string& ip, vector<smb_share>& out, int timeout_ms)
+{
+  smb_context c{timeout_ms};
+  if(!c) { log("Error: smbc_init_context() failed.", "red"); return false; }
+
+  const string url = ip.find(':') == ip.npos ? "smb://" + ip : "smb://[" + ip + "]";
+  SMBCFILE* dir = smbc_getFunctionOpendir(c.ctx)(c.ctx, url.c_str());
+  if(!dir)
+   {
+    if(errno != EACCES && errno != EPERM)
+      log("Error: can't list shares of " + ip + ": " + s_errno(), "orange");
+    return false;
+   }
+  while(const smbc_dirent* e = smbc_getFunctionReaddir(c.ctx)(c.ctx, dir))
+    if(e->smbc_type == SMBC_FILE_SHARE)
+      out.emplace_back(smb_share{e->name, e->comment ? e->comment : ""});
+  smbc_getFunctionClosedir(c.ctx)(c.ctx, dir);
+  return true;
+}
+//-------------------------------------------------------------------------------------------------
+#else
+
+bool smb_native_available() { return false; }
+
+bool smb_list_shares(const string&, vector<smb_share>&, int)
+{ log("Error: mount-gui was built without libsmbclient.", "red"); return false; }
+//-------------------------------------------------------------------------------------------------
+#endif
@@ -0,0 +1,43 @@
+/* Copyright (c) 2015-2023 Kovshov K.A.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/** @file smb_shares.h
+ *  @author Kovshov K.A. (kirillnow@gmail.com)
+ *  @brief In-process SMB share enumeration (libsmbclient).
+ */
+
+#ifndef SMB_SHARES_H
+#define SMB_SHARES_H
+//-------------------------------------------------------------------------------------------------
+#include <string>
+#include <vector>
+
+struct smb_share { std::string name, comment; };
+
+/** @brief True if mount-gui was built with libsmbclient (-DUSE_LIBSMBCLIENT=ON)
+ *  and the library could be initialized, smbclient(1) should be used otherwise.
+ */
+bool smb_native_available();
+
+/** @brief List disk shares of a host anonymously, like `smbclient -NgL ip`.
+ *  @details Thread-safe, each call uses its own libsmbclient context.
+ *  @param timeout_ms Connection/response timeout, 0 - library default.
+ *  Returns false on error (logged, except for refused anonymous access).
+ */
+bool smb_list_shares(const std::string& ip, std::vector<smb_share>& out, int timeout_ms = 0);
+//-------------------------------------------------------------------------------------------------
+#endif // SMB_SHARES_H
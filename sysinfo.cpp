@@ -0,0 +1,543 @@
+/* Copyright (c) 2015-2023 Kovshov K.A.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/** @file sysinfo.cpp
+ *  @author Kovshov K.A. (kirillnow@gmail.com)
+ *  @brief Reading device information directly from sysfs, udev database and procfs.
+ */
+//-------------------------------------------------------------------------------------------------
+
+#include "sysinfo.h"
+#include "base.h"
+#include <algorithm>
+#include <charconv>
+#include <clocale>
+#include <climits>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <linux/netlink.h>
+#include <sys/socket.h>
+#include <sys/statvfs.h>
+
+using namespace std;
+using enum device_info::column;
+//-------------------------------------------------------------------------------------------------
+
+static const string sys_block = "/sys/class/block/";
+//-------------------------------------------------------------------------------------------------
+
+static bool read_file(const string& path, string& out, size_t size_hint = 512)
+{
+  int fd = open(path.c_str(), O_RDONLY|O_CLOEXEC);
+  if(fd < 0) return false;
+  size_t len = 0; ssize_t n;
+  out.resize(size_hint);
+  while((n = read(fd, out.data() + len, out.size() - len)) != 0)
+   {
+    if(n > 0 && (len += n) == out.size()) out.resize(len * 2);
+    if(n < 0 && errno != EINTR) break;
+   }
+  close(fd);
+  out.resize(len);
+  return n == 0;
+}
+//-------------------------------------------------------------------------------------------------
+
+std::string read_sysfs_attr(const std::string& path)
+{
+  string r;
+  if(!read_file(path, r)) return {};
+  while(r.size() && isspace((unsigned char)r.back())) r.pop_back();
+  return r;
+}
+//-------------------------------------------------------------------------------------------------
+
+static vector<string> list_dir(const string& path)
+{
+  vector<string> res;
+  if(DIR* d = opendir(path.c_str()))
+   {
+    for(dirent* e; (e = readdir(d));)
+      if(e->d_name[0] != '.') res.emplace_back(e->d_name);
+    closedir(d);
+   }
+  return res;
+}
+//-------------------------------------------------------------------------------------------------
+
+std::string lsblk_size(uint64_t bytes)
+{
+  //mirrors size_to_human_string() from util-linux
+  int exp = 0;
+  while(exp < 60 && bytes >= (1ULL << (exp + 10))) exp += 10;
+  uint64_t dec = bytes >> exp, frac = exp ? bytes & ((1ULL << exp) - 1) : 0;
+  if(frac)
+   {
+    frac = (frac >= UINT64_MAX / 1000) ? ((frac / 1024) * 1000) >> (exp - 10)
+                                       : (frac * 1000) >> exp;
+    if((frac = (frac + 50) / 100) == 10) { ++dec; frac = 0; }
+   }
+  string r = to_string(dec);
+  if(frac)
+   {
+    const lconv* l = localeconv();
+    r.append((l && l->decimal_point && *l->decimal_point) ? l->decimal_point : ".");
+    r.push_back(char('0' + frac));
+   }
+  r.push_back("BKMGTPE"[exp / 10]);
+  return r;
+}
+//-------------------------------------------------------------------------------------------------
+
+///Properties ("E:" lines) from /run/udev/data/b<major>:<minor>
+static map<string, string, less<>> read_udev_db(const string& devno)
+{
+  map<string, string, less<>> r;
+  string data;
+  if(!read_file("/run/udev/data/b" + devno, data)) return r;
+  for(size_t p = 0, e; p < data.size(); p = e + 1)
+   {
+    if((e = data.find('\n', p)) == string::npos) e = data.size();
+    string_view l{data.data() + p, e - p};
+    if(!starts_with(l, "E:")) continue;
+    if(auto [n, v, ok] = split2v(l.substr(2), '='); ok) r.emplace(n, v);
+   }
+  return r;
+}
+//-------------------------------------------------------------------------------------------------
+
+static string block_type(const string& base, const string& kname, bool partition)
+{
+  if(partition) return "part";
+  if(exists(base + "dm"))
+   {
+    string uuid = read_sysfs_attr(base + "dm/uuid");
+    size_t p = uuid.find('-');
+    if(p == string::npos || !p) return "dm";
+    uuid.resize(p);
+    for(char& c : uuid) c = tolower(c);
+    return uuid;
+   }
+  if(starts_with(kname, "loop")) return "loop";
+  if(starts_with(kname, "md"))
+   { string l = read_sysfs_attr(base + "md/level"); return l.empty() ? "md" : l; }
+
+  static const char* scsi_types[] = {"disk", "tape", "printer", "processor",
+                                     "worm", "rom",  "scanner", "mo", "changer", "comm"};
+  unsigned t = 0;
+  string st = read_sysfs_attr(base + "device/type");
+  from_chars(st.data(), st.data() + st.size(), t);
+  return t < size(scsi_types) ? scsi_types[t] : "disk";
+}
+//-------------------------------------------------------------------------------------------------
+
+///Same test as sysfs_blkdev_is_hotpluggable() in util-linux
+static bool is_hotpluggable(const string& kname)
+{
+  if(read_sysfs_attr(sys_block + kname + "/removable") == "1") return true;
+  char rp[PATH_MAX];
+  if(!realpath((sys_block + kname).c_str(), rp)) return false;
+  for(string p = rp; p.size() > sizeof "/sys/devices"; p.resize(p.rfind('/')))
+   {
+    char b[PATH_MAX]; ssize_t l;
+    if((l = readlink((p + "/subsystem").c_str(), b, sizeof b)) <= 0) continue;
+    string_view s{b, size_t(l)};
+    s.remove_prefix(s.rfind('/') + 1);
+    for(const char* x : {"usb", "ieee1394", "pcmcia", "mmc", "ccw"})
+      if(s == x) return true;
+   }
+  return false;
+}
+//-------------------------------------------------------------------------------------------------
+
+namespace {
+struct sys_blkdev { string kname, parent; unsigned major, minor; device_info info; };
+struct disk_attr  { string rm, hotplug; };
+}
+
+///Read one /sys/class/block entry; false if it is missing or hidden by lsblk.
+static bool read_block_device(const string& kname, sys_blkdev& d, map<string, disk_attr>& disks)
+{
+  const string base = sys_block + kname + '/';
+  const string devno = read_sysfs_attr(base + "dev"), sz = read_sysfs_attr(base + "size");
+  unsigned major = 0, minor = 0; uint64_t sectors = 0;
+  auto [mj, mn, ok] = split2v(devno, ':');
+  if(!ok || from_chars(mj.data(), mj.data() + mj.size(), major).ec != errc{} ||
+            from_chars(mn.data(), mn.data() + mn.size(), minor).ec != errc{})
+    return false;
+  from_chars(sz.data(), sz.data() + sz.size(), sectors);
+  //lsblk skips RAM disks and unused loop devices
+  if(major == 1 || (!sectors && starts_with(kname, "loop"))) return false;
+
+  d = sys_blkdev{kname, {}, major, minor, {}};
+  device_info& i = d.info;
+
+  const bool partition = exists(base + "partition");
+  vector<string> slaves = list_dir(base + "slaves");
+  string disk = kname;
+  if(char rp[PATH_MAX]; partition && realpath(base.c_str(), rp))
+   {
+    string_view p = rp;
+    p.remove_suffix(p.size() - p.rfind('/'));
+    d.parent = disk = string{p.substr(p.rfind('/') + 1)};
+   }
+  else if(slaves.size()) d.parent = *min_element(slaves.begin(), slaves.end());
+
+  string name = kname, dm_name = read_sysfs_attr(base + "dm/name");
+  replace(name.begin(), name.end(), '!', '/'); //e.g. cciss!c0d0
+  i[NAME]   = dm_name.empty() ? name : dm_name;
+  i[PATH]   = dm_name.empty() ? "/dev/" + name : "/dev/mapper/" + dm_name;
+  i[PKNAME] = d.parent;
+  i[SIZE]   = lsblk_size(sectors * 512);
+  i[TYPE]   = block_type(base, kname, partition);
+
+  auto [da, ins] = disks.try_emplace(disk);
+  if(ins)
+   {
+    da->second.rm      = read_sysfs_attr(sys_block + disk + "/removable");
+    da->second.hotplug = is_hotpluggable(disk) ? "1" : "0";
+    if(da->second.rm.empty()) da->second.rm = "0";
+   }
+  i[RM] = da->second.rm; i[HOTPLUG] = da->second.hotplug;
+
+  auto props = read_udev_db(devno);
+  auto prop  = [&](initializer_list<const char*> keys, bool hex = false) -> string
+   {
+    for(const char* k : keys)
+      if(auto it = props.find(k); it != props.end() && it->second.size())
+        return hex ? unescape_hex(it->second) : it->second;
+    return {};
+   };
+  i[FSTYPE]    = prop({"ID_FS_TYPE"});
+  i[LABEL]     = prop({"ID_FS_LABEL_ENC"}, true);
+  i[UUID]      = prop({"ID_FS_UUID_ENC"},  true);
+  i[PARTLABEL] = prop({"ID_PART_ENTRY_NAME"}, true);
+  i[PARTUUID]  = prop({"ID_PART_ENTRY_UUID"});
+  if(!partition && slaves.empty())
+   {
+    string &model = i[MODEL], &serial = i[SERIAL];
+    if((model = prop({"ID_MODEL_ENC"}, true)).empty())
+      model = read_sysfs_attr(base + "device/model");
+    if((serial = prop({"ID_SCSI_SERIAL", "ID_SERIAL_SHORT"})).empty())
+      serial = read_sysfs_attr(base + "device/serial");
+    model = trim(model); serial = trim(serial);
+   }
+  return true;
+}
+//-------------------------------------------------------------------------------------------------
+
+bool sysfs_read_device(const std::string& kname, device_info& out)
+{
+  sys_blkdev d;
+  map<string, disk_attr> disks;
+  if(kname.empty() || kname.find('/') != string::npos || !read_block_device(kname, d, disks))
+    return false;
+  out = std::move(d.info);
+  return true;
+}
+//-------------------------------------------------------------------------------------------------
+
+bool sysfs_scan_devices(device_map& out)
+{
+  vector<string> names = list_dir(sys_block);
+  if(names.empty()) return false;
+  sort(names.begin(), names.end());
+
+  vector<sys_blkdev> devs; devs.reserve(names.size());
+  map<string, disk_attr> disks;
+  for(const string& kname : names)
+    if(read_block_device(kname, devs.emplace_back(), disks) == false) devs.pop_back();
+
+  //lsblk order: parents followed by their children
+  sort(devs.begin(), devs.end(), [](auto&& l, auto&& r)
+       { return l.major == r.major ? l.minor < r.minor : l.major < r.major; });
+  map<string_view, vector<size_t>> children;
+  for(size_t n = 0; n < devs.size(); ++n)
+    if(devs[n].parent.size()) children[devs[n].parent].push_back(n);
+
+  vector<bool> done(devs.size());
+  out.reserve(out.size() + devs.size());
+  auto emit = [&](auto& self, size_t n) -> void
+   {
+    done[n] = true;
+    out.emplace_back(std::move(devs[n].info));
+    if(auto it = children.find(devs[n].kname); it != children.end())
+      for(size_t c : it->second) if(!done[c]) self(self, c);
+   };
+  for(size_t n = 0; n < devs.size(); ++n)
+    if(devs[n].parent.empty() || !binary_search(names.begin(), names.end(), devs[n].parent))
+      if(!done[n]) emit(emit, n);
+  for(size_t n = 0; n < devs.size(); ++n) if(!done[n]) emit(emit, n);
+  return true;
+}
+//-------------------------------------------------------------------------------------------------
+
+bool usb_mtp_interface_present()
+{
+  static const string usb_devices = "/sys/bus/usb/devices/";
+  for(const string& n : list_dir(usb_devices))
+   {
+    if(n.find(':') == string::npos) continue; //not an interface
+    const string base = usb_devices + n + '/';
+    const string cls = read_sysfs_attr(base + "bInterfaceClass");
+    if(cls == "06") return true;              //Still Image (PTP)
+    if(cls == "ff" && read_sysfs_attr(base + "interface").find("MTP") != string::npos)
+      return true;                            //vendor specific, as probed by libmtp
+   }
+  return false;
+}
+//-------------------------------------------------------------------------------------------------
+
+///Decode \ooo sequences in place.
+static string_view unescape_octal(char* f, char* l) noexcept
+{
+  if(!memchr(f, '\\', l - f)) return {f, size_t(l - f)};
+  auto oct = [](char c) { return c >= '0' && c <= '7'; };
+  char* o = f;
+  for(char* i = f; i < l; ++i, ++o)
+    if(*i == '\\' && l - i > 3 && oct(i[1]) && oct(i[2]) && oct(i[3]))
+     { *o = char((i[1] - '0') * 64 + (i[2] - '0') * 8 + (i[3] - '0')); i += 3; }
+    else *o = *i;
+  return {f, size_t(o - f)};
+}
+//-------------------------------------------------------------------------------------------------
+
+bool mountinfo_table::read(const char* path)
+{
+  entries.clear();
+  if(!read_file(path, buffer, 1 << 16))
+   { log("Failed to read '"s + path + "': " + s_errno()); return false; }
+
+  char *p = buffer.data(), *end = p + buffer.size();
+  for(char* eol; p < end; p = eol + 1)
+   {
+    if(!(eol = (char*)memchr(p, '\n', end - p))) eol = end;
+    //36 35 98:0 /mnt1 /mnt2 rw,noatime master:1 - ext3 /dev/root rw,errors=continue
+    string_view fld[10]; int n = 0;
+    for(char *f = p, *l; f < eol && n < 10; f = l + 1)
+     {
+      if(!(l = (char*)memchr(f, ' ', eol - f))) l = eol;
+      if(n == 6 && string_view(f, l - f) != "-") continue; //optional fields
+      fld[n++] = unescape_octal(f, l);
+     }
+    if(n < 10) continue;
+
+    mountinfo_entry e{};
+    auto num = [](string_view s, unsigned& v) { from_chars(s.data(), s.data() + s.size(), v); };
+    auto [mj, mn, ok] = split2v(fld[2], ':');
+    num(fld[0], e.id); num(fld[1], e.parent); num(mj, e.major); num(mn, e.minor);
+    e.root   = fld[3]; e.target = fld[4]; e.vfs_opts = fld[5];
+    e.fstype = fld[7]; e.source = fld[8]; e.fs_opts  = fld[9];
+    entries.push_back(e);
+   }
+  return true;
+}
+//-------------------------------------------------------------------------------------------------
+
+std::string mountinfo_entry::options() const
+{
+  //same as merge_optstr() in libmount: "rw"/"ro" are taken from VFS options only
+  string r{vfs_opts};
+  if(fs_opts == vfs_opts) return r;
+  for(string_view o = fs_opts; o.size();)
+   {
+    auto [x, rest, more] = split2v(o, ',');
+    if(x.size() && x != "rw" && x != "ro") { if(r.size()) { r += ','; } r += x; }
+    o = more ? rest : string_view{};
+   }
+  return r;
+}
+//-------------------------------------------------------------------------------------------------
+
+namespace {
+
+/** @brief statvfs() workers shared by all mount_sizes() calls.
+ *  @details statvfs() can't be interrupted while NFS server or FUSE daemon doesn't respond.
+ *  Workers are detached and the pool is never destroyed, so a blocked call does not delay
+ *  program exit. A target is not queued again until its previous call returns, and there are
+ *  at most pool_size workers, so blocked calls can't pile up.
+ */
+class statvfs_pool
+{
+  static constexpr unsigned pool_size = 4;
+  mutex lock;
+  condition_variable_any cv;
+  deque<string> queue;
+  unordered_set<string> busy;           ///<queued or being queried
+  unordered_map<string, string> sizes;  ///<results not taken yet
+  unsigned workers = 0;
+
+  void worker()
+  {
+    for(;;)
+     {
+      unique_lock l{lock};
+      cv.wait(l, [this] { return queue.size(); });
+      string target = std::move(queue.front());
+      queue.pop_front();
+      l.unlock();
+      struct statvfs sv{};
+      string sz = statvfs(target.c_str(), &sv) ? "" : lsblk_size((uint64_t)sv.f_blocks * sv.f_frsize);
+      l.lock();
+      busy.erase(target);
+      sizes[std::move(target)] = std::move(sz);
+      cv.notify_all();
+     }
+  }
+
+public:
+  vector<string> get(const vector<string>& targets, int timeout_ms, const stop_token& stop)
+  {
+    vector<string> res(targets.size());
+    vector<bool> wanted(targets.size());
+    unique_lock l{lock};
+    for(size_t i = 0; i < targets.size(); ++i)
+     {
+      const string& t = targets[i];
+      if(busy.insert(t).second) queue.push_back(t);
+      else if(find(targets.begin(), targets.begin() + i, t) == targets.begin() + i)
+       {
+        log("Size of " + t + " is unknown, previous statvfs() did not return yet.", "orange");
+        continue;
+       }
+      wanted[i] = true;
+     }
+    for(; workers < min<size_t>(pool_size, queue.size()); ++workers)
+      thread([this] { worker(); }).detach();
+    cv.notify_all();
+
+    auto pending = [&](size_t i) { return wanted[i] && busy.contains(targets[i]); };
+    cv.wait_for(l, stop, chrono::milliseconds(timeout_ms), [&]
+     {
+      for(size_t i = 0; i < targets.size(); ++i) if(pending(i)) return false;
+      return true;
+     });
+    for(size_t i = 0; i < targets.size(); ++i)
+      if(pending(i)) log("Size of " + targets[i] + " is unknown, statvfs() did not return.",
+                         "orange");
+      else if(auto it = sizes.find(targets[i]); wanted[i] && it != sizes.end())
+        res[i] = it->second;
+    for(size_t i = 0; i < targets.size(); ++i) if(!pending(i)) sizes.erase(targets[i]);
+    return res;
+  }
+};
+
+} //namespace
+
+std::vector<std::string> mount_sizes(const std::vector<std::string>& targets, int timeout_ms,
+                                     const std::stop_token& stop)
+{
+  static statvfs_pool& pool = *new statvfs_pool;
+  return pool.get(targets, timeout_ms, stop);
+}
+//-------------------------------------------------------------------------------------------------
+
+int uevent_open()
+{
+  //udevd rebroadcasts events after its rules (and the udev database) are done
+  const bool udev = exists("/run/udev/control");
+  int fd = socket(AF_NETLINK, SOCK_DGRAM|SOCK_CLOEXEC|SOCK_NONBLOCK, NETLINK_KOBJECT_UEVENT);
+  if(fd < 0) { log("Failed to open uevent socket: " + s_errno(), "orange"); return -1; }
+  sockaddr_nl addr{};
+  addr.nl_family = AF_NETLINK;
+  addr.nl_groups = udev ? uevent_group_udev : uevent_group_kernel;
+  const int on = 1;
+  if(setsockopt(fd, SOL_SOCKET, SO_PASSCRED, &on, sizeof(on)) ||
+     bind(fd, (sockaddr*)&addr, sizeof(addr)))
+   {
+    log("Failed to bind uevent socket: " + s_errno(), "orange");
+    close(fd);
+    return -1;
+   }
+  return fd;
+}
+//-------------------------------------------------------------------------------------------------
+
+bool uevent_receive(int fd, std::vector<uevent>& out)
+{
+  char buff[8192];
+  alignas(cmsghdr) char cbuff[CMSG_SPACE(sizeof(ucred))];
+  for(;;)
+   {
+    sockaddr_nl addr{};
+    iovec iov{buff, sizeof(buff)};
+    msghdr msg{};
+    msg.msg_name = &addr;       msg.msg_namelen = sizeof(addr);
+    msg.msg_iov = &iov;         msg.msg_iovlen = 1;
+    msg.msg_control = cbuff;    msg.msg_controllen = sizeof(cbuff);
+    ssize_t n = recvmsg(fd, &msg, 0);
+    if(n < 0)
+     {
+      if(errno == EINTR) continue;
+      if(errno == EAGAIN || errno == EWOULDBLOCK) return true;
+      log("Failed to read uevent socket: " + s_errno(), "orange"); //ENOBUFS: events were lost
+      return false;
+     }
+    //only accept messages from the kernel or root-owned udevd
+    cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+    if(!cm || cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_CREDENTIALS ||
+       ((ucred*)CMSG_DATA(cm))->uid != 0 || (msg.msg_flags & MSG_TRUNC))
+      continue;
+
+    string_view m{buff, size_t(n)};
+    if(starts_with(m, "libudev"))
+     {
+      //struct udev_monitor_netlink_header: prefix[8], magic, header_size, properties_off, ...
+      uint32_t magic, off;
+      if(addr.nl_pid == 0 || m.size() < 20) continue;
+      memcpy(&magic, buff + 8, 4); memcpy(&off, buff + 16, 4);
+      if(ntohl(magic) != 0xfeedcafe || off >= m.size()) continue;
+      m.remove_prefix(off);
+     }
+    else
+     {
+      //"action@devpath\0KEY=VALUE\0..."
+      size_t hdr = m.find('\0');
+      if(addr.nl_pid != 0 || hdr == string_view::npos || m.find('@') > hdr) continue;
+      m.remove_prefix(hdr + 1);
+     }
+
+    uevent& e = out.emplace_back();
+    while(m.size())
+     {
+      string_view kv = m.substr(0, m.find('\0'));
+      m.remove_prefix(min(kv.size() + 1, m.size()));
+      auto [k, v, ok] = split2v(kv, '=');
+      if(!ok) continue;
+      if(k == "ACTION")         e.action = v;
+      else if(k == "SUBSYSTEM") e.subsystem = v;
+      else if(k == "DEVTYPE")   e.devtype = v;
+      else if(k == "DEVPATH")   e.devpath = v;
+      else if(k == "DEVNAME")   e.devname = v;
+      else if(k == "DM_NAME")   e.dm_name = v;
+      else if(k == "BUSNUM")    from_chars(v.data(), v.data() + v.size(), e.busnum);
+      else if(k == "DEVNUM")    from_chars(v.data(), v.data() + v.size(), e.devnum);
+     }
+    if(e.action.empty() || e.devpath.empty()) out.pop_back();
+   }
+}
+//-------------------------------------------------------------------------------------------------
@@ -0,0 +1,109 @@
+/* Copyright (c) 2015-2023 Kovshov K.A.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/** @file sysinfo.h
+ *  @author Kovshov K.A. (kirillnow@gmail.com)
+ *  @brief Reading device information directly from sysfs, udev database and procfs.
+ */
+
+#ifndef SYSINFO_H
+#define SYSINFO_H
+//-------------------------------------------------------------------------------------------------
+#include "devmap.h"
+#include <string>
+#include <string_view>
+#include <stop_token>
+#include <vector>
+
+//-------------------------------------------------------------------------------------------------
+///One line of /proc/self/mountinfo, octal escapes (\040 etc.) are already decoded.
+struct mountinfo_entry
+{
+  unsigned id, parent, major, minor;
+  std::string_view root, target, vfs_opts, fstype, source, fs_opts;
+
+  ///VFS and superblock options merged the way findmnt shows them.
+  std::string options() const;
+};
+
+/** @brief Parsed /proc/self/mountinfo.
+ *  @details All entries point into a single read buffer, so the table is not copyable.
+ */
+class mountinfo_table
+{
+  std::string buffer;
+public:
+  std::vector<mountinfo_entry> entries;
+
+  mountinfo_table() = default;
+  mountinfo_table(const mountinfo_table&) = delete;
+  mountinfo_table& operator=(const mountinfo_table&) = delete;
+
+  bool read(const char* path = "/proc/self/mountinfo");
+};
+//-------------------------------------------------------------------------------------------------
+///Device event from the kernel or udevd (only the properties used by mount-gui).
+struct uevent
+{
+  std::string action, subsystem, devtype, devpath, devname, dm_name;
+  unsigned busnum = 0, devnum = 0; //USB devices
+};
+//-------------------------------------------------------------------------------------------------
+/** @brief Enumerate block devices from /sys/class/block (in-process lsblk replacement).
+ *  @details Filesystem LABEL, UUID, etc. are taken from the udev database (/run/udev/data).
+ *  Fills the same columns as `lsblk -nPo NAME,PATH,PKNAME,...`, parents before children.
+ *  Returns false if sysfs is unavailable.
+ */
+bool sysfs_scan_devices(device_map& out);
+
+/** @brief Read single block device by kernel name (e.g. "sda1").
+ *  @details Returns false if the device does not exist or would not be listed by lsblk.
+ */
+bool sysfs_read_device(const std::string& kname, device_info& out);
+
+///True if any USB interface looks like PTP/MTP (libmtp is not needed otherwise).
+bool usb_mtp_interface_present();
+
+///Read small sysfs/procfs file, trailing whitespace is removed.
+std::string read_sysfs_attr(const std::string& path);
+
+///Format size the way `lsblk` does (e.g. "931.5G").
+std::string lsblk_size(uint64_t bytes);
+
+/** @brief Sizes of mounted filesystems (statvfs), formatted like findmnt SIZE column.
+ *  @details Filesystems are queried on a small shared worker pool. Sizes not known by the
+ *  deadline (e.g. of a dead NFS server) or stop request are empty, their workers are left
+ *  blocked in statvfs(); such targets are skipped by later calls until statvfs() returns.
+ */
+std::vector<std::string> mount_sizes(const std::vector<std::string>& targets, int timeout_ms,
+                                     const std::stop_token& stop = {});
+
+///NETLINK_KOBJECT_UEVENT multicast groups.
+enum : unsigned { uevent_group_kernel = 1, uevent_group_udev = 2 };
+
+/** @brief Open non-blocking uevent socket.
+ *  @details Subscribes to udevd events if udevd is running (so the udev database is already
+ *  updated when an event arrives), to raw kernel events otherwise. Returns -1 on error.
+ */
+int uevent_open();
+
+/** @brief Read all pending events from uevent socket, appending them to `out`.
+ *  @details Returns false on socket error, including lost events (ENOBUFS).
+ */
+bool uevent_receive(int fd, std::vector<uevent>& out);
+//-------------------------------------------------------------------------------------------------
+#endif // SYSINFO_H
@@ -24,10 +24,11 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "systemd_dialog.h"
 #include "ui_systemd_dialog.h"
 #include "common/systemd_escape.h"
-#include "common/execute.h"
+#include "common/qexecute.h"
 #include "common/regex.h"
 #include "common/vect_op.h"
 #include <locale>
+#include <QPointer>
 #include <fstream>
 #include <vector>
 #include <string>
@@ -105,10 +106,10 @@ SystemdDialog::SystemdDialog(MainWindow *parent, bool fstab, mount_info& mnt_inf
   ui->LabelWhere->setText(qstr(mnt_info.target));
   RadioSelect();
 
-  ui->RadioLABEL->setEnabled(mnt_info.dev && mnt_info.dev->at("LABEL").size());
-  ui->RadioUUID->setEnabled(mnt_info.dev  && mnt_info.dev->at("UUID").size());
-  ui->RadioPARTLABEL->setEnabled(mnt_info.dev && mnt_info.dev->at("PARTLABEL").size());
-  ui->RadioPARTUUID->setEnabled(mnt_info.dev  && mnt_info.dev->at("PARTUUID").size());
+  ui->RadioLABEL->setEnabled(mnt_info.dev && mnt_info.dev->at(device_info::LABEL).size());
+  ui->RadioUUID->setEnabled(mnt_info.dev  && mnt_info.dev->at(device_info::UUID).size());
+  ui->RadioPARTLABEL->setEnabled(mnt_info.dev && mnt_info.dev->at(device_info::PARTLABEL).size());
+  ui->RadioPARTUUID->setEnabled(mnt_info.dev  && mnt_info.dev->at(device_info::PARTUUID).size());
 
   ui->CheckAutomount->setChecked(contains_opt(mnt_info.options, "x-systemd.automount"));
   ui->CheckRwOnly->setChecked(contains_opt(mnt_info.options, "x-systemd.rw-only"));
@@ -314,10 +315,20 @@ void SystemdDialog::Accept()
   if(!priv.drop_if_feasible(usr_info))
    { MsgBoxErr("Error!", "Failed to drop superuser privileges!\nSee log for details."); return; }
 
-  if(execute(params, true, false, content))
-   { MsgBoxErr("Error!", "Failed to modify system configuration!\nSee log for details."); return; }
-
-  log("System configuration was modified succefully.", "green");
-  accept();
+  //dialog stays open, but disabled, until the command finishes
+  QPointer<SystemdDialog> self{this};
+  auto done = [self](int status, auto&)
+   {
+    if(!self) return;
+    self->setEnabled(true);
+    if(status)
+     { QMessageBox::critical(self, qstr("Error!"),
+                             qstr("Failed to modify system configuration!\nSee log for details."));
+       return; }
+    log("System configuration was modified succefully.", "green");
+    self->accept();
+   };
+  if(execute_async(params, std::move(done), true, false, content)) setEnabled(false);
+  else MsgBoxErr("Error!", "Failed to modify system configuration!\nSee log for details.");
 }
 //-------------------------------------------------------------------------------------------------
@@ -0,0 +1,263 @@
+/* Copyright (c) 2015-2023 Kovshov K.A.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/** @file rpc_responder.cpp
+ *  @author Kovshov K.A. (kirillnow@gmail.com)
+ *  @brief Stand-in portmapper and mountd to test and benchmark nfs_list_exports() locally.
+ *  @details Usage: rpc_responder [-a address]... [-n exports] [-f fragment] [-d delay_ms] [-m port]
+ *  Listens on port 111 (portmapper), -m (mountd, 20048 by default) and 2049 (NFS) of every -a
+ *  address (127.0.0.1 by default), e.g. 127.0.0.1 ... 127.0.0.254 simulate a subnet of servers.
+ *  Serves PMAPPROC_GETPORT (mountd over TCP), MOUNTPROC3_EXPORT (-n exports) and NULL
+ *  procedure of any program (NFSv4 ping). Replies are split into record marking fragments of
+ *  -f bytes (single fragment by default) and delayed by -d ms.
+ *  Ports below 1024 require root or CAP_NET_BIND_SERVICE.
+ */
+//-------------------------------------------------------------------------------------------------
+
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+using namespace std;
+using clock_type = chrono::steady_clock;
+//-------------------------------------------------------------------------------------------------
+
+enum : uint32_t { PMAP_PROG = 100000, PMAPPROC_GETPORT = 3, PMAP_PORT = 111,
+                  MOUNT_PROG = 100005, MOUNTPROC3_EXPORT = 5, NFS_PROG = 100003, NFS_PORT = 2049,
+                  PROC_NULL = 0, RPC_TCP = 6, LAST_FRAGMENT = 0x80000000u };
+constexpr size_t max_record = 1 << 20;
+
+static struct
+{
+  int      exports    = 16;
+  size_t   fragment   = 0;      ///<0 - whole reply in one fragment
+  int      delay_ms   = 0;
+  uint16_t mount_port = 20048;
+} prm;
+//-------------------------------------------------------------------------------------------------
+
+static void put_u32(string& b, uint32_t v) { v = htonl(v); b.append((const char*)&v, 4); }
+
+static void put_str(string& b, string_view s)
+{
+  put_u32(b, s.size()); b += s; b.append((4 - s.size() % 4) % 4, '\0');
+}
+
+static bool get_u32(string_view& b, uint32_t& v)
+{
+  if(b.size() < 4) return false;
+  memcpy(&v, b.data(), 4); v = ntohl(v); b.remove_prefix(4);
+  return true;
+}
+//-------------------------------------------------------------------------------------------------
+
+///Reply to a single call (without record mark), empty if the message is not a valid call.
+static string handle_call(string_view m)
+{
+  uint32_t xid, type, rpcvers, prog, vers, proc;
+  if(!get_u32(m, xid) || !get_u32(m, type) || !get_u32(m, rpcvers) || type != 0 || rpcvers != 2 ||
+     !get_u32(m, prog) || !get_u32(m, vers) || !get_u32(m, proc))
+    return {};
+  for(int i = 0; i < 2; ++i) //credentials and verifier
+   {
+    uint32_t flavor, len;
+    if(!get_u32(m, flavor) || !get_u32(m, len) || len > 400 || ((len + 3) & ~3u) > m.size())
+      return {};
+    m.remove_prefix((len + 3) & ~3u);
+   }
+
+  string r;
+  put_u32(r, xid); put_u32(r, 1 /*REPLY*/); put_u32(r, 0 /*MSG_ACCEPTED*/);
+  put_u32(r, 0); put_u32(r, 0); //verifier: AUTH_NONE
+  if(proc == PROC_NULL) { put_u32(r, 0 /*SUCCESS*/); return r; }
+
+  if(prog == PMAP_PROG && proc == PMAPPROC_GETPORT)
+   {
+    uint32_t q_prog, q_vers, q_prot, q_port;
+    if(!get_u32(m, q_prog) || !get_u32(m, q_vers) || !get_u32(m, q_prot) || !get_u32(m, q_port))
+     { put_u32(r, 4 /*GARBAGE_ARGS*/); return r; }
+    put_u32(r, 0);
+    put_u32(r, (q_prog == MOUNT_PROG && q_prot == RPC_TCP) ? prm.mount_port : 0);
+    return r;
+   }
+  if(prog == MOUNT_PROG && proc == MOUNTPROC3_EXPORT)
+   {
+    put_u32(r, 0);
+    for(int i = 0; i < prm.exports; ++i)
+     {
+      put_u32(r, 1); put_str(r, "/srv/nfs/export" + to_string(i + 1));
+      put_u32(r, 1); put_str(r, "*"); put_u32(r, 0); //groups
+     }
+    put_u32(r, 0);
+    return r;
+   }
+  const bool known = (prog == PMAP_PROG || prog == MOUNT_PROG || prog == NFS_PROG);
+  put_u32(r, known ? 3 /*PROC_UNAVAIL*/ : 1 /*PROG_UNAVAIL*/);
+  return r;
+}
+//-------------------------------------------------------------------------------------------------
+
+///Append reply with record marking, split into fragments of prm.fragment bytes.
+static void append_record(string& out, string_view msg)
+{
+  const size_t frag = prm.fragment ? prm.fragment : msg.size();
+  do
+   {
+    const size_t n = min(frag, msg.size());
+    put_u32(out, uint32_t(n) | (n == msg.size() ? LAST_FRAGMENT : 0u));
+    out.append(msg.substr(0, n)); msg.remove_prefix(n);
+   }
+  while(msg.size());
+}
+//-------------------------------------------------------------------------------------------------
+
+struct connection
+{
+  int fd;
+  string in, out;
+  clock_type::time_point send_at;
+  bool closed = false;
+
+  ///Answer all complete records in `in`; false if the stream is malformed.
+  bool process()
+  {
+    for(;;)
+     {
+      string msg;
+      size_t pos = 0;
+      for(uint32_t hdr = 0; !(hdr & LAST_FRAGMENT); )
+       {
+        if(in.size() - pos < 4) return true;
+        memcpy(&hdr, in.data() + pos, 4); hdr = ntohl(hdr);
+        const size_t len = hdr & ~LAST_FRAGMENT;
+        if(msg.size() + len > max_record) return false;
+        if(in.size() - pos - 4 < len) return true;
+        msg.append(in, pos + 4, len); pos += 4 + len;
+       }
+      in.erase(0, pos);
+      string reply = handle_call(msg);
+      if(reply.empty()) return false;
+      if(out.empty()) send_at = clock_type::now() + chrono::milliseconds(prm.delay_ms);
+      append_record(out, reply);
+     }
+  }
+};
+//-------------------------------------------------------------------------------------------------
+
+static int listen_on(const char* addr, uint16_t port)
+{
+  const addrinfo hints{AI_NUMERICHOST|AI_NUMERICSERV|AI_PASSIVE, AF_UNSPEC, SOCK_STREAM,
+                       IPPROTO_TCP};
+  addrinfo* ai;
+  if(int e = getaddrinfo(addr, to_string(port).c_str(), &hints, &ai))
+   { fprintf(stderr, "%s: %s\n", addr, gai_strerror(e)); exit(1); }
+  int fd = socket(ai->ai_family, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, IPPROTO_TCP);
+  const int on = 1;
+  if(fd < 0 || setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on) ||
+     bind(fd, ai->ai_addr, ai->ai_addrlen) || listen(fd, 128))
+   { fprintf(stderr, "%s port %u: %s\n", addr, port, strerror(errno)); exit(1); }
+  freeaddrinfo(ai);
+  return fd;
+}
+//-------------------------------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+  vector<const char*> addrs;
+  for(int c; (c = getopt(argc, argv, "a:n:f:d:m:h")) != -1;)
+    switch(c)
+     {
+      case 'a': addrs.push_back(optarg); break;
+      case 'n': prm.exports    = max(0, atoi(optarg)); break;
+      case 'f': prm.fragment   = strtoul(optarg, nullptr, 10); break;
+      case 'd': prm.delay_ms   = max(0, atoi(optarg)); break;
+      case 'm': prm.mount_port = uint16_t(atoi(optarg)); break;
+      default:
+        fprintf(stderr, "Usage: %s [-a address]... [-n exports] [-f fragment] [-d delay_ms] "
+                        "[-m mountd port]\n", argv[0]);
+        return c == 'h' ? 0 : 1;
+     }
+  if(addrs.empty()) addrs.push_back("127.0.0.1");
+
+  vector<int> listeners;
+  for(const char* a : addrs)
+    for(uint16_t port : {uint16_t(PMAP_PORT), prm.mount_port, uint16_t(NFS_PORT)})
+      listeners.push_back(listen_on(a, port));
+  printf("Serving %d exports on %zu address(es), ports %u, %u, %u.\n", prm.exports, addrs.size(),
+         PMAP_PORT, prm.mount_port, NFS_PORT);
+  fflush(stdout);
+
+  vector<connection> conns;
+  vector<pollfd> pfd;
+  for(;;)
+   {
+    const auto now = clock_type::now();
+    int timeout = -1;
+    pfd.clear();
+    for(int l : listeners) pfd.push_back({l, POLLIN, 0});
+    for(auto& c : conns)
+     {
+      short ev = POLLIN;
+      if(c.out.size() && now >= c.send_at) ev |= POLLOUT;
+      else if(c.out.size())
+       {
+        auto ms = chrono::ceil<chrono::milliseconds>(c.send_at - now).count();
+        timeout = timeout < 0 ? int(ms) : min(timeout, int(ms));
+       }
+      pfd.push_back({c.fd, ev, 0});
+     }
+    if(poll(pfd.data(), pfd.size(), timeout) < 0 && errno != EINTR)
+     { perror("poll()"); return 1; }
+
+    for(size_t i = 0; i < listeners.size(); ++i)
+      if(pfd[i].revents)
+        for(int fd; (fd = accept4(listeners[i], nullptr, nullptr, SOCK_NONBLOCK|SOCK_CLOEXEC)) >= 0;)
+          conns.push_back({fd, {}, {}, {}});
+
+    for(size_t i = listeners.size(); i < pfd.size(); ++i)
+     {
+      connection& c = conns[i - listeners.size()];
+      if(pfd[i].revents & (POLLIN|POLLHUP|POLLERR))
+       {
+        char buff[65536];
+        ssize_t n = recv(c.fd, buff, sizeof buff, 0);
+        if(n > 0) { c.in.append(buff, n); c.closed = !c.process(); }
+        else if(n == 0 || (errno != EAGAIN && errno != EINTR)) c.closed = true;
+       }
+      if(!c.closed && (pfd[i].revents & POLLOUT))
+       {
+        ssize_t n = send(c.fd, c.out.data(), c.out.size(), MSG_NOSIGNAL);
+        if(n > 0) c.out.erase(0, n);
+        else if(n < 0 && errno != EAGAIN && errno != EINTR) c.closed = true;
+       }
+     }
+    erase_if(conns, [](connection& c) { if(c.closed) close(c.fd); return c.closed; });
+   }
+}
+//-------------------------------------------------------------------------------------------------
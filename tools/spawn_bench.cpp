@@ -0,0 +1,111 @@
+/* Copyright (c) 2015-2023 Kovshov K.A.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/** @file spawn_bench.cpp
+ *  @author Kovshov K.A. (kirillnow@gmail.com)
+ *  @brief Process launch latency: posix_spawn() (as used by Tp_open) vs fork() + exec().
+ *  @details Usage: spawn_bench [iterations] [ballast MiB]...
+ *  Defaults are 200 iterations at 0, 64, 256 and 1024 MiB of touched ballast, which grows RSS
+ *  (and page tables fork() has to copy) the way a long running Qt process does.
+ */
+//-------------------------------------------------------------------------------------------------
+
+#include "common/hires_timer.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+using namespace std;
+static const char* const child_argv[] = {"/bin/true", nullptr};
+//-------------------------------------------------------------------------------------------------
+
+static pid_t launch_spawn()
+{
+  pid_t pid = -1;
+  if(int rt = posix_spawn(&pid, child_argv[0], nullptr, nullptr, (char* const*)child_argv, environ))
+   { fprintf(stderr, "posix_spawn(): %s\n", strerror(rt)); exit(1); }
+  return pid;
+}
+//-------------------------------------------------------------------------------------------------
+
+static pid_t launch_fork()
+{
+  pid_t pid = fork();
+  if(pid < 0) { perror("fork()"); exit(1); }
+  if(!pid) { execv(child_argv[0], (char* const*)child_argv); _exit(127); }
+  return pid;
+}
+//-------------------------------------------------------------------------------------------------
+
+///Median and mean of launch (until the call returns) and round trip (until child is reaped), µs.
+struct bench_result { double launch_med, launch_avg, total_med, total_avg; };
+
+static bench_result run(pid_t (*launch)(), int iterations)
+{
+  vector<int64_t> launch_us, total_us;
+  for(int i = 0; i < iterations; ++i)
+   {
+    hires_timer t;
+    pid_t pid = launch();
+    launch_us.push_back(t.microseconds());
+    int status;
+    while(waitpid(pid, &status, 0) < 0 && errno == EINTR) ;
+    total_us.push_back(t.microseconds());
+   }
+  auto med = [](vector<int64_t>& v) { ranges::sort(v); return (double)v[v.size() / 2]; };
+  auto avg = [](vector<int64_t>& v) { int64_t s = 0; for(auto x : v) s += x; return (double)s / v.size(); };
+  return {med(launch_us), avg(launch_us), med(total_us), avg(total_us)};
+}
+//-------------------------------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+  int iterations = argc > 1 ? atoi(argv[1]) : 200;
+  vector<size_t> sizes;
+  for(int i = 2; i < argc; ++i) sizes.push_back(strtoul(argv[i], nullptr, 10));
+  if(sizes.empty()) sizes = {0, 64, 256, 1024};
+  if(iterations < 1) { fprintf(stderr, "Usage: %s [iterations] [ballast MiB]...\n", argv[0]); return 1; }
+
+  printf("%10s  %-12s %12s %12s %12s %12s\n", "ballast", "method",
+         "launch med", "launch avg", "total med", "total avg");
+  unique_ptr<char[]> ballast;
+  for(size_t mib : sizes)
+   {
+    ballast.reset();
+    if(mib)
+     {
+      ballast = make_unique_for_overwrite<char[]>(mib << 20);
+      memset(ballast.get(), 1, mib << 20); //make it resident
+     }
+    for(auto [name, launch] : {pair{"posix_spawn", &launch_spawn}, pair{"fork+exec", &launch_fork}})
+     {
+      bench_result r = run(launch, iterations);
+      printf("%7zu MiB  %-12s %9.1f µs %9.1f µs %9.1f µs %9.1f µs\n", mib, name,
+             r.launch_med, r.launch_avg, r.total_med, r.total_avg);
+     }
+   }
+  return 0;
+}
+//-------------------------------------------------------------------------------------------------